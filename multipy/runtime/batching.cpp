@@ -0,0 +1,186 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <multipy/runtime/Exception.h>
+#include <multipy/runtime/batching.h>
+
+#include <ATen/ATen.h>
+#include <c10/util/irange.h>
+
+namespace torch {
+namespace deploy {
+
+namespace {
+
+// Returns rows [offset, offset + rows) of the batched result `value`.
+at::IValue sliceRows(
+    const at::IValue& value,
+    int64_t offset,
+    int64_t rows,
+    int64_t totalRows) {
+  if (value.isTensor()) {
+    const at::Tensor& t = value.toTensor();
+    MULTIPY_CHECK(
+        t.dim() > 0 && t.size(0) == totalRows,
+        "batched result does not have the batch size as its first dimension");
+    return t.narrow(0, offset, rows);
+  }
+  if (value.isTuple()) {
+    std::vector<at::IValue> elements;
+    for (const auto& element : value.toTupleRef().elements()) {
+      elements.push_back(sliceRows(element, offset, rows, totalRows));
+    }
+    return c10::ivalue::Tuple::create(std::move(elements));
+  }
+  MULTIPY_CHECK(false, "batched result must be a tensor or a tuple of tensors");
+  return at::IValue();
+}
+
+// Returns true if each input of `a` can be concatenated along dim 0 with the
+// input of `b` at the same position.
+bool canConcatenate(
+    const std::vector<at::Tensor>& a,
+    const std::vector<at::Tensor>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (const auto i : c10::irange(a.size())) {
+    if (a[i].scalar_type() != b[i].scalar_type() ||
+        a[i].device() != b[i].device() || a[i].layout() != b[i].layout() ||
+        a[i].dim() != b[i].dim() ||
+        a[i].sizes().slice(1) != b[i].sizes().slice(1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+BatchedObj::BatchedObj(ReplicatedObj obj, BatchingOptions options)
+    : obj_(std::move(obj)), options_(options) {
+  MULTIPY_CHECK(options_.maxBatchSize > 0, "maxBatchSize must be positive");
+}
+
+at::IValue BatchedObj::operator()(at::ArrayRef<at::IValue> args) {
+  Request request;
+  for (const auto& arg : args) {
+    if (!arg.isTensor() || arg.toTensor().dim() == 0) {
+      return obj_(args);
+    }
+    request.inputs.push_back(arg.toTensor());
+  }
+  if (request.inputs.empty()) {
+    return obj_(args);
+  }
+  request.rows = request.inputs[0].size(0);
+  for (const auto& input : request.inputs) {
+    if (input.size(0) != request.rows) {
+      return obj_(args);
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  pending_.push_back(&request);
+  if (pending_.size() >= options_.maxBatchSize) {
+    cv_.notify_all();
+  }
+  // The first queued caller to find no leader collects a batch and runs it,
+  // the others wait for their result to be published. Leadership is released
+  // before running so the next batch can be collected while this one executes.
+  while (!request.done) {
+    if (leaderActive_ || !request.queued) {
+      cv_.wait(lock);
+      continue;
+    }
+    leaderActive_ = true;
+    cv_.wait_for(lock, options_.maxWait, [this]() {
+      return pending_.size() >= options_.maxBatchSize;
+    });
+    auto batch = takeBatch();
+    leaderActive_ = false;
+    cv_.notify_all();
+    lock.unlock();
+    runBatch(batch);
+    lock.lock();
+    cv_.notify_all();
+  }
+  if (request.error) {
+    std::rethrow_exception(request.error);
+  }
+  return std::move(request.result);
+}
+
+std::vector<BatchedObj::Request*> BatchedObj::takeBatch() {
+  // merge the oldest requests whose inputs can be concatenated with those of
+  // the oldest one, the others are left for a later batch so that they cannot
+  // fail this one.
+  std::vector<Request*> batch;
+  std::vector<Request*> rest;
+  const auto& first = pending_.front()->inputs;
+  for (Request* request : pending_) {
+    if (batch.size() < options_.maxBatchSize &&
+        canConcatenate(request->inputs, first)) {
+      request->queued = false;
+      batch.push_back(request);
+    } else {
+      rest.push_back(request);
+    }
+  }
+  pending_ = std::move(rest);
+  return batch;
+}
+
+void BatchedObj::runBatch(const std::vector<Request*>& batch) {
+  std::vector<at::IValue> results;
+  std::exception_ptr error;
+  try {
+    std::vector<at::IValue> args;
+    int64_t totalRows = 0;
+    if (batch.size() == 1) {
+      args.assign(batch[0]->inputs.begin(), batch[0]->inputs.end());
+    } else {
+      for (const auto i : c10::irange(batch[0]->inputs.size())) {
+        std::vector<at::Tensor> column;
+        column.reserve(batch.size());
+        for (Request* request : batch) {
+          column.push_back(request->inputs[i]);
+        }
+        args.emplace_back(at::cat(column, 0));
+      }
+    }
+    for (Request* request : batch) {
+      totalRows += request->rows;
+    }
+    at::IValue output = obj_(args);
+    if (batch.size() == 1) {
+      results.push_back(std::move(output));
+    } else {
+      int64_t offset = 0;
+      for (Request* request : batch) {
+        results.push_back(sliceRows(output, offset, request->rows, totalRows));
+        offset += request->rows;
+      }
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  // requests live on the stack of their callers, which wait under mutex_
+  // until they are marked done.
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (const auto i : c10::irange(batch.size())) {
+    if (error) {
+      batch[i]->error = error;
+    } else {
+      batch[i]->result = std::move(results[i]);
+    }
+    batch[i]->done = true;
+  }
+}
+
+} // namespace deploy
+} // namespace torch
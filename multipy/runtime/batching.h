@@ -0,0 +1,71 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+#include <multipy/runtime/deploy.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+namespace torch {
+namespace deploy {
+
+/// Options controlling how `BatchedObj` groups concurrent calls.
+struct BatchingOptions {
+  /// Maximum number of calls merged into a single call to the model.
+  size_t maxBatchSize = 8;
+  /// Maximum time the first call of a batch waits for other calls to join it.
+  std::chrono::microseconds maxWait{500};
+};
+
+/// BatchedObj is an opt-in front-end around a `ReplicatedObj` which merges
+/// calls made concurrently from several threads into a single call. The
+/// tensor arguments of the merged calls are concatenated along dim 0, the
+/// model is called once on one interpreter and its result, a tensor or a
+/// tuple of tensors, is split along dim 0 back to each caller.
+///
+/// Every positional argument of a call must be a tensor whose first dimension
+/// is the batch dimension; calls with other arguments, or whose arguments
+/// disagree on the batch size, are forwarded to the wrapped `ReplicatedObj`
+/// unbatched. Only calls whose arguments can be concatenated, i.e. with the
+/// same number of arguments of the same dtypes, devices and sizes besides the
+/// first dimension, are merged together.
+class TORCH_API BatchedObj {
+ public:
+  explicit BatchedObj(ReplicatedObj obj, BatchingOptions options = {});
+
+  /// Invokes the wrapped object with `args`, possibly batched together with
+  /// calls from other threads, and returns this call's share of the result.
+  at::IValue operator()(at::ArrayRef<at::IValue> args);
+
+  BatchedObj(const BatchedObj&) = delete;
+  BatchedObj& operator=(const BatchedObj&) = delete;
+
+ private:
+  struct Request {
+    std::vector<at::Tensor> inputs;
+    int64_t rows = 0;
+    at::IValue result;
+    std::exception_ptr error;
+    bool queued = true;
+    bool done = false;
+  };
+  std::vector<Request*> takeBatch();
+  void runBatch(const std::vector<Request*>& batch);
+
+  ReplicatedObj obj_;
+  BatchingOptions options_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Request*> pending_;
+  bool leaderActive_ = false;
+};
+
+} // namespace deploy
+} // namespace torch
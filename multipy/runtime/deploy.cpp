@@ -6,13 +6,18 @@
 
 #include <dlfcn.h>
 #include <libgen.h>
+#include <c10/util/hash.h>
+#include <sys/types.h>
 #include <multipy/runtime/Exception.h>
 #include <multipy/runtime/deploy.h>
+#include <multipy/runtime/loader.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <functional>
 #include <optional>
 #include <stdexcept>
+#include <unordered_set>
 
 // these symbols are generated by cmake, using ld -r -b binary
 // libtorch_deployinterpreter.so which takes the contents of the so and embeds
@@ -49,37 +54,120 @@ const std::initializer_list<ExeSection> multipyTorchSections = {
 };
 const std::initializer_list<InterpreterSymbol> multipyTorchSymbols = {};
 
+namespace {
+std::shared_ptr<EmbeddedFile> extractInterpreterImage() {
+  return EmbeddedFile::extractOnce(
+      "interpreter_image", pythonInterpreterSections, pythonInterpreterSymbols);
+}
+
+// The extracted files and the registries of the custom loader are shared by
+// the whole process, so they are locked across every fork(), not only the
+// ones made by InterpreterManager::fork, always in this order.
+void lockProcessStateForFork() {
+  EmbeddedFile::lockForFork();
+  loader_lock_for_fork();
+}
+
+void unlockProcessStateInParent() {
+  loader_unlock_after_fork(/*child*/ false);
+  EmbeddedFile::unlockAfterFork();
+}
+
+void unlockProcessStateInChild() {
+  loader_unlock_after_fork(/*child*/ true);
+  EmbeddedFile::unlockAfterFork();
+}
+
+void installForkHandlers() {
+  static const int installed = pthread_atfork(
+      lockProcessStateForFork,
+      unlockProcessStateInParent,
+      unlockProcessStateInChild);
+  (void)installed;
+}
+} // namespace
+
 InterpreterManager::InterpreterManager(
     size_t nInterp,
-    std::shared_ptr<Environment> env)
-    : resources_(nInterp) {
+    std::shared_ptr<Environment> env,
+    LoadBalancerPolicy policy,
+    InterpreterInitMode initMode)
+    : resources_(nInterp, policy),
+      pendingUnloads_(nInterp),
+      hasPendingUnloads_(new std::atomic<bool>[nInterp]()) {
   C10_LOG_API_USAGE_ONCE("torch.deploy.InterpreterManager");
+  installForkHandlers();
 
   // disable GIL deadlock detection if it's not set already
   setenv("TORCH_DISABLE_DEADLOCK_DETECTION", "1", /*overwrite*/ 0);
   // disable prims/torch.Library support
   setenv("PYTORCH_DISABLE_LIBRARY", "1", /*overwrite*/ 0);
 
-  for (const auto i : c10::irange(nInterp)) {
-#ifdef FBCODE_CAFFE2
-    instances_.emplace_back(this, env);
-#else
-    instances_.emplace_back(env);
-#endif
-    auto I = instances_.back().acquireSession();
-    // make torch.version.interp be the interpreter id
-    // can be used for balancing work across GPUs
-    I.global("torch", "version").attr("__setattr__")({"interp", int(i)});
-    instances_.back().pImpl_->setFindModule(
-        [this](const std::string& name) -> std::optional<std::string> {
-          auto it = registeredModuleSource_.find(name);
-          if (it != registeredModuleSource_.end()) {
-            return it->second;
-          } else {
-            return std::nullopt;
-          }
-        });
+  auto begin = std::chrono::steady_clock::now();
+  // every interpreter copies the image, it is kept until all of them are
+  // created so that it is only extracted once.
+  auto interpreterImage = extractInterpreterImage();
+  // each interpreter has its own copy of python, so unless initMode is
+  // InterpreterInitMode::Serial they are created concurrently. The
+  // host state they share is locked: the extracted images, the registries of
+  // the custom loader and registeredModuleSource_, which is only read. Still
+  // it is opt-in, since the environment's configureInterpreter and the
+  // extension modules imported while initializing python may not expect to
+  // run on several threads. Interpreters are built in place and moved into
+  // instances_ once all of them are ready, so that instances_ is never
+  // resized while another thread uses it.
+  std::vector<std::optional<Interpreter>> created(nInterp);
+  std::vector<std::exception_ptr> errors(nInterp);
+  std::atomic<size_t> next{0};
+  auto createInterpreters = [&]() {
+    for (size_t i = next++; i < nInterp; i = next++) {
+      try {
+        auto& interp = created[i].emplace(Interpreter(
+            this,
+            env,
+            std::chrono::steady_clock::now(),
+            initMode == InterpreterInitMode::ParallelLoad));
+        auto I = interp.acquireSession();
+        // make torch.version.interp be the interpreter id
+        // can be used for balancing work across GPUs
+        I.global("torch", "version").attr("__setattr__")({"interp", int(i)});
+        interp.pImpl_->setFindModule(
+            [this](const std::string& name) -> std::optional<std::string> {
+              auto it = registeredModuleSource_.find(name);
+              if (it != registeredModuleSource_.end()) {
+                return it->second;
+              } else {
+                return std::nullopt;
+              }
+            });
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+  size_t nThreads = initMode != InterpreterInitMode::Serial
+      ? std::min<size_t>(
+            nInterp, std::max(1U, std::thread::hardware_concurrency()))
+      : 1;
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < nThreads; ++i) {
+    threads.emplace_back(createInterpreters);
   }
+  createInterpreters();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  instances_.reserve(nInterp);
+  for (auto& interp : created) {
+    instances_.emplace_back(std::move(*interp));
+  }
+  startupTime_ = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
 
   // Pre-registered modules.
   // Since torch::deploy::Obj.toIValue cannot infer empty list, we hack it to
@@ -96,6 +184,169 @@ InterpreterManager::InterpreterManager(
       "    return names\n");
 }
 
+pid_t InterpreterManager::fork() {
+  MULTIPY_CHECK(
+      workers_.empty(),
+      "Cannot fork an InterpreterManager after submit() started its workers");
+  // sessions free their interpreter in the load balancer before releasing the
+  // GIL, so the GILs have to be taken before the load balancer's lock. A
+  // ReplicatedObj released under movablesMutex_ queues its unload, so that
+  // lock comes before pendingUnloadsMutex_. The process-wide state is locked
+  // last, by the handlers of installForkHandlers.
+  for (auto& interp : instances_) {
+    interp.pImpl_->beforeFork();
+  }
+  resources_.beforeFork();
+  movablesMutex_.lock();
+  pendingUnloadsMutex_.lock();
+  pid_t pid = ::fork();
+  pendingUnloadsMutex_.unlock();
+  movablesMutex_.unlock();
+  for (auto& interp : instances_) {
+    if (pid == 0) {
+      interp.pImpl_->afterForkChild();
+    } else {
+      interp.pImpl_->afterForkParent();
+    }
+  }
+  resources_.afterFork(pid == 0);
+  return pid;
+}
+
+// NOLINTNEXTLINE(bugprone-exception-escape)
+InterpreterManager::~InterpreterManager() {
+  {
+    std::lock_guard<std::mutex> guard(tasksMutex_);
+    stopWorkers_ = true;
+  }
+  tasksAvailable_.notify_all();
+  // workers finish the tasks already submitted before exiting, and must be
+  // gone before the interpreters they run on are destroyed.
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void InterpreterManager::startWorkers() {
+  for (const auto i : c10::irange(instances_.size())) {
+    workers_.emplace_back([this, i]() { runWorker(i); });
+  }
+}
+
+void InterpreterManager::runWorker(size_t where) {
+  while (true) {
+    std::function<void(const Interpreter*)> task;
+    {
+      std::unique_lock<std::mutex> guard(tasksMutex_);
+      tasksAvailable_.wait(
+          guard, [this]() { return stopWorkers_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    // account for the worker in the load balancer so that acquireOne prefers
+    // other interpreters while this one is running a task.
+    resources_.acquireAt(where);
+    task(&instances_[where]);
+    resources_.free(where);
+  }
+}
+
+std::vector<std::chrono::microseconds> InterpreterManager::replicateEverywhere(
+    const ReplicatedObj& obj) {
+  std::vector<std::chrono::microseconds> timings(instances_.size());
+  std::vector<std::exception_ptr> errors(instances_.size());
+  std::vector<std::thread> threads;
+  for (const auto i : c10::irange(instances_.size())) {
+    threads.emplace_back([this, &obj, &timings, &errors, i]() {
+      // keep acquireOne away from the interpreter while it is unpickling.
+      resources_.acquireAt(i);
+      try {
+        auto begin = std::chrono::steady_clock::now();
+        obj.acquireSession(&instances_[i]);
+        timings[i] = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - begin);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+      resources_.free(i);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return timings;
+}
+
+c10::intrusive_ptr<c10::ivalue::Future> InterpreterManager::submit(
+    ReplicatedObj obj,
+    std::vector<at::IValue> args,
+    std::unordered_map<std::string, c10::IValue> kwargs) {
+  std::call_once(workersStarted_, [this]() { startWorkers(); });
+  auto future = c10::make_intrusive<c10::ivalue::Future>(c10::AnyType::get());
+  {
+    std::lock_guard<std::mutex> guard(tasksMutex_);
+    MULTIPY_CHECK(
+        !stopWorkers_, "Cannot submit to an InterpreterManager being destroyed");
+    tasks_.emplace_back([obj = std::move(obj),
+                         args = std::move(args),
+                         kwargs = std::move(kwargs),
+                         future](const Interpreter* interp) mutable {
+      at::IValue result;
+      try {
+        // release the session before completing the future, so callbacks
+        // attached to it do not run while holding this interpreter.
+        auto I = obj.acquireSession(interp);
+        result =
+            I.self.callKwargs(std::move(args), std::move(kwargs)).toIValue();
+      } catch (...) {
+        future->setError(std::current_exception());
+        return;
+      }
+      future->markCompleted(std::move(result));
+    });
+  }
+  tasksAvailable_.notify_one();
+  return future;
+}
+
+std::vector<CallResult> InterpreterManager::callMany(
+    at::ArrayRef<std::pair<ReplicatedObj, std::vector<at::IValue>>> calls) {
+  std::vector<CallResult> results(calls.size());
+  // declared before the handles below, so that they are destroyed while the
+  // session still holds the GIL.
+  InterpreterSession I = acquireOne();
+  std::vector<std::pair<Obj, at::ArrayRef<at::IValue>>> objCalls;
+  std::vector<size_t> callIndex;
+  objCalls.reserve(calls.size());
+  callIndex.reserve(calls.size());
+  for (size_t i = 0, N = calls.size(); i != N; ++i) {
+    ReplicatedObjImpl& obj = *calls[i].first.pImpl_;
+    if (obj.manager_ != this) {
+      results[i].error = "ReplicatedObj belongs to another InterpreterManager";
+      continue;
+    }
+    try {
+      objCalls.emplace_back(I.fromMovable(calls[i].first), calls[i].second);
+      callIndex.push_back(i);
+    } catch (const std::exception& err) {
+      results[i].error = err.what();
+    }
+  }
+  auto called = I.callMany(objCalls);
+  for (size_t i = 0, N = called.size(); i != N; ++i) {
+    results[callIndex[i]] = std::move(called[i]);
+  }
+  return results;
+}
+
 Package InterpreterManager::loadPackage(const std::string& uri) {
   return Package(uri, this);
 }
@@ -106,19 +357,148 @@ Package InterpreterManager::loadPackage(
 }
 
 Obj InterpreterSession::fromMovable(const ReplicatedObj& obj) {
-  return impl_->unpickleOrGet(obj.pImpl_->objectId_, obj.pImpl_->data_);
+  Obj loaded = impl_->unpickleOrGet(obj.pImpl_->objectId_, obj.pImpl_->data_);
+  obj.pImpl_->setLoaded(interpreter_, true);
+  return loaded;
+}
+
+Obj InterpreterSession::methodFromMovable(
+    const ReplicatedObj& obj,
+    const std::string& name) {
+  Obj method =
+      impl_->methodOrGet(obj.pImpl_->objectId_, obj.pImpl_->data_, name);
+  obj.pImpl_->setLoaded(interpreter_, true);
+  return method;
 }
 
 InterpreterSession ReplicatedObj::acquireSession(
     const Interpreter* onThisInterpreter) const {
+  InterpreterSession I = acquireSessionWithoutSelf(onThisInterpreter);
+  I.self = I.fromMovable(*this);
+  return I;
+}
+
+InterpreterSession ReplicatedObj::acquireSessionWithoutSelf(
+    const Interpreter* onThisInterpreter) const {
   MULTIPY_CHECK(
       (pImpl_->manager_ || onThisInterpreter),
       "ReplicatedObjImpl needs an interpreter or needs to be associated with an InterpreterManager in order to use this functionality without onThisInterpreter. \
       This behavior may be deprecated in the future and holds no backwards compatibility guarentees.");
-  InterpreterSession I = onThisInterpreter ? onThisInterpreter->acquireSession()
-                                           : pImpl_->manager_->acquireOne();
-  I.self = I.fromMovable(*this);
-  return I;
+  if (onThisInterpreter) {
+    return onThisInterpreter->acquireSession();
+  }
+  return pImpl_->manager_->acquiredSession(pImpl_->acquireInterpreter());
+}
+
+std::vector<std::chrono::microseconds> ReplicatedObj::warmup() const {
+  MULTIPY_CHECK(
+      pImpl_->manager_,
+      "ReplicatedObjImpl must be created from an InterpreterManager in order to warm it up");
+  return pImpl_->manager_->replicateEverywhere(*this);
+}
+
+void ReplicatedObj::setAffinity(ReplicaAffinity affinity) {
+  MULTIPY_CHECK(
+      pImpl_->manager_,
+      "ReplicatedObjImpl must be created from an InterpreterManager to set its affinity");
+  MULTIPY_CHECK(
+      affinity.policy != ReplicaAffinityPolicy::Pinned ||
+          affinity.maxReplicas > 0,
+      "Pinned affinity needs at least one interpreter");
+  pImpl_->affinity_ = affinity;
+}
+
+BoundCall ReplicatedObj::bind(CallSignature signature, std::string methodName)
+    const {
+  return BoundCall(*this, std::move(methodName), std::move(signature));
+}
+
+BoundCall::BoundCall(
+    ReplicatedObj obj,
+    std::string methodName,
+    CallSignature signature)
+    : obj_(std::move(obj)), methodName_(std::move(methodName)) {
+  static std::atomic<int64_t> nextSignatureId{1};
+  std::unordered_set<std::string> names;
+  for (const auto* arguments : {&signature.positional, &signature.keyword}) {
+    for (const auto& arg : *arguments) {
+      MULTIPY_CHECK(
+          names.insert(arg.name).second,
+          "duplicate argument '" + arg.name + "' in call signature");
+    }
+  }
+  signature.id = nextSignatureId.fetch_add(1);
+  signature_ = std::make_shared<const CallSignature>(std::move(signature));
+}
+
+at::IValue BoundCall::operator()(at::ArrayRef<at::IValue> args) const {
+  const CallSignature& signature = *signature_;
+  const size_t nargs = signature.positional.size();
+  MULTIPY_CHECK(
+      args.size() == nargs + signature.keyword.size(),
+      "expected " + std::to_string(nargs + signature.keyword.size()) +
+          " arguments but got " + std::to_string(args.size()));
+  for (size_t i = 0, N = args.size(); i != N; ++i) {
+    const CallArgument& arg =
+        i < nargs ? signature.positional[i] : signature.keyword[i - nargs];
+    MULTIPY_CHECK(
+        matchesKind(args[i], arg.kind),
+        "argument '" + arg.name + "' has an unexpected type " +
+            args[i].tagKind());
+  }
+  // the object and its bound method are cached by each interpreter, so only
+  // the first call on an interpreter looks them up.
+  auto I = obj_.acquireSessionWithoutSelf();
+  Obj target = methodName_.empty() ? I.fromMovable(obj_)
+                                   : I.methodFromMovable(obj_, methodName_);
+  return target.call(signature, args).toIValue();
+}
+
+int ReplicatedObjImpl::acquireInterpreter() {
+  LoadBalancer& resources = manager_->resources_;
+  const int n = static_cast<int>(loadedOn_.size());
+  switch (affinity_.policy) {
+    case ReplicaAffinityPolicy::Any:
+      break;
+    case ReplicaAffinityPolicy::Pinned: {
+      // spread the pinned sets of different objects over the interpreters.
+      std::vector<int> pinned;
+      for (const auto i :
+           c10::irange(std::min<size_t>(affinity_.maxReplicas, n))) {
+        pinned.push_back(static_cast<int>((objectId_ + i) % n));
+      }
+      return resources.acquireAmong(pinned, /*shareBusy=*/true);
+    }
+    case ReplicaAffinityPolicy::PreferLoaded: {
+      std::vector<int> loaded;
+      for (const auto i : c10::irange(n)) {
+        if (loadedOn_[i].load(std::memory_order_relaxed)) {
+          loaded.push_back(i);
+        }
+      }
+      int where = resources.acquireAmong(loaded, /*shareBusy=*/false);
+      if (where >= 0) {
+        return where;
+      }
+      if (!loaded.empty() && affinity_.maxReplicas > 0 &&
+          loaded.size() >= affinity_.maxReplicas) {
+        return resources.acquireAmong(loaded, /*shareBusy=*/true);
+      }
+      break;
+    }
+  }
+  return resources.acquire();
+}
+
+void ReplicatedObjImpl::setLoaded(const Interpreter* interp, bool loaded) {
+  if (!manager_ || !interp) {
+    return;
+  }
+  auto instances = manager_->allInstances();
+  if (interp >= instances.begin() && interp < instances.end()) {
+    loadedOn_[interp - instances.begin()].store(
+        loaded, std::memory_order_relaxed);
+  }
 }
 
 Obj ReplicatedObj::toObj(InterpreterSession* I) {
@@ -136,6 +516,8 @@ bool InterpreterSession::attachDeconstructorCallback(
 
 // NOLINTNEXTLINE(bugprone-exception-escape)
 InterpreterSession::~InterpreterSession() {
+  // `self` is released while `impl_` still holds the GIL of its interpreter.
+  self = Obj();
   if (deconstruction_callback_ != nullptr) {
     deconstruction_callback_();
   }
@@ -147,19 +529,84 @@ void ReplicatedObjImpl::unload(const Interpreter* onThisInterpreter) {
     MULTIPY_CHECK(
         manager_,
         "ReplicatedObjImpl must be created from an InterpreterManager in order to unload without an interpreter");
-    for (auto& interp : manager_->allInstances()) {
-      unload(&interp);
+    // interpreters which never loaded the object are not disturbed.
+    auto instances = manager_->allInstances();
+    for (const auto i : c10::irange(instances.size())) {
+      if (loadedOn_[i].load(std::memory_order_relaxed)) {
+        unload(&instances[i]);
+      }
     }
     return;
   }
 
   InterpreterSession I = onThisInterpreter->acquireSession();
   I.impl_->unload(objectId_);
+  setLoaded(onThisInterpreter, false);
+  std::lock_guard<std::mutex> guard(argumentNamesMutex_);
+  argumentNames_.clear();
 }
 
-// NOLINTNEXTLINE(bugprone-exception-escape)
 ReplicatedObjImpl::~ReplicatedObjImpl() {
-  unload(nullptr);
+  if (manager_) {
+    manager_->queueUnload(objectId_, loadedOn_);
+  }
+}
+
+void InterpreterManager::queueUnload(
+    int64_t id,
+    const std::vector<std::atomic<bool>>& loadedOn) {
+  std::lock_guard<std::mutex> guard(pendingUnloadsMutex_);
+  for (const auto i : c10::irange(pendingUnloads_.size())) {
+    if (loadedOn[i].load(std::memory_order_relaxed)) {
+      pendingUnloads_[i].push_back(id);
+      hasPendingUnloads_[i].store(true, std::memory_order_release);
+    }
+  }
+}
+
+void InterpreterManager::collect() {
+  for (const auto i : c10::irange(instances_.size())) {
+    if (hasPendingUnloads_[i].load(std::memory_order_acquire)) {
+      // acquiring the session applies the pending unloads.
+      instances_[i].acquireSession();
+    }
+  }
+}
+
+void InterpreterManager::applyPendingUnloads(
+    const Interpreter* interp,
+    InterpreterSession& I) {
+  // interpreters still being created are not in instances_ yet and have
+  // nothing to unload.
+  auto instances = allInstances();
+  if (interp < instances.begin() || interp >= instances.end()) {
+    return;
+  }
+  const size_t where = interp - instances.begin();
+  if (!hasPendingUnloads_[where].load(std::memory_order_acquire)) {
+    return;
+  }
+  std::vector<int64_t> ids;
+  {
+    std::lock_guard<std::mutex> guard(pendingUnloadsMutex_);
+    ids.swap(pendingUnloads_[where]);
+    hasPendingUnloads_[where].store(false, std::memory_order_relaxed);
+  }
+  for (int64_t id : ids) {
+    try {
+      I.impl_->unload(id);
+    } catch (const std::exception&) {
+      // the object is gone from C++ and cannot be loaded again, failing to
+      // drop it only leaks it in this interpreter.
+    }
+  }
+}
+
+void Interpreter::onSessionAcquired(InterpreterSession& I) const {
+  I.interpreter_ = this;
+  if (manager_) {
+    manager_->applyPendingUnloads(this, I);
+  }
 }
 
 void ReplicatedObj::unload(const Interpreter* onThisInterpreter) {
@@ -184,15 +631,79 @@ InterpreterSession::createMovable(Obj obj) {
   return manager_->createMovable(obj, this);
 }
 
+namespace {
+// Hash of the pickle bytes and the identities of the storages of `obj`.
+size_t contentHash(const PickledObject& obj) {
+  size_t hash = std::hash<std::string>()(*obj.data_);
+  for (const auto& storage : obj.storages_) {
+    hash = c10::hash_combine(
+        hash, std::hash<const void*>()(storage.unsafeGetStorageImpl()));
+  }
+  return c10::hash_combine(
+      hash, std::hash<const void*>()(obj.containerFile_.get()));
+}
+
+bool sameContent(const PickledObject& a, const PickledObject& b) {
+  if (*a.data_ != *b.data_ || a.types_ != b.types_ ||
+      a.containerFile_ != b.containerFile_ ||
+      a.storages_.size() != b.storages_.size()) {
+    return false;
+  }
+  for (size_t i = 0, N = a.storages_.size(); i != N; ++i) {
+    if (!a.storages_[i].is_alias_of(b.storages_[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
 ReplicatedObj InterpreterManager::createMovable(
     Obj obj,
-    InterpreterSession* I) {
+    InterpreterSession* I,
+    bool deduplicate) {
   MULTIPY_CHECK(
       I->isOwner(obj),
       "Cannot create movable from an object that lives in different session");
   PickledObject pickled = I->pickleObj(obj);
-  return ReplicatedObj(std::make_shared<ReplicatedObjImpl>(
-      I->nextObjectId_++, std::move(pickled), this));
+  if (!deduplicate) {
+    return ReplicatedObj(std::make_shared<ReplicatedObjImpl>(
+        I->nextObjectId_.fetch_add(1), std::move(pickled), this));
+  }
+
+  size_t hash = contentHash(pickled);
+  std::lock_guard<std::mutex> guard(movablesMutex_);
+  auto range = movables_.equal_range(hash);
+  for (auto it = range.first; it != range.second;) {
+    auto existing = it->second.lock();
+    if (!existing) {
+      it = movables_.erase(it);
+      continue;
+    }
+    if (sameContent(existing->data_, pickled)) {
+      return ReplicatedObj(std::move(existing));
+    }
+    ++it;
+  }
+  auto impl = std::make_shared<ReplicatedObjImpl>(
+      I->nextObjectId_.fetch_add(1), std::move(pickled), this);
+  movables_.emplace(hash, impl);
+  return ReplicatedObj(std::move(impl));
+}
+
+Obj InterpreterSession::moveTo(Obj obj, InterpreterSession& target) {
+  PickledObject pickled = pickleObj(obj);
+  return target.impl_->unpickle(pickled);
+}
+
+std::vector<CallResult> InterpreterSession::callMany(
+    at::ArrayRef<std::pair<Obj, at::ArrayRef<at::IValue>>> calls) {
+  for (const auto& call : calls) {
+    MULTIPY_CHECK(
+        impl_->isOwner(call.first),
+        "Cannot call an object that lives in different session");
+  }
+  return impl_->callMany(calls);
 }
 
 PickledObject InterpreterSession::pickleObj(Obj obj) {
@@ -224,16 +735,39 @@ static dlopen_t find_real_dlopen() {
   return dlopen_;
 }
 
+namespace {
+// Held while initializing python with InterpreterInitMode::ParallelLoad.
+std::mutex& serialInitMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::chrono::microseconds elapsedSince(
+    std::chrono::steady_clock::time_point& since) {
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - since);
+  since = now;
+  return elapsed;
+}
+} // namespace
+
 Interpreter::Interpreter(
     InterpreterManager* manager,
-    std::shared_ptr<Environment> env)
+    std::shared_ptr<Environment> env,
+    std::chrono::steady_clock::time_point begin,
+    bool serializeInitialize)
     : handle_(nullptr),
       manager_(manager),
       env_(env),
-      interpreterFile_(
-          "interpreter",
-          pythonInterpreterSections,
-          pythonInterpreterSymbols) {
+      interpreterFile_("interpreter", *extractInterpreterImage()) {
+  auto phaseBegin = begin;
+#ifndef FBCODE_CAFFE2
+  torchPluginFile_ = EmbeddedFile::extractOnce(
+      "multipy_torch", multipyTorchSections, multipyTorchSymbols);
+#endif
+  startupTimings_.extract = elapsedSince(phaseBegin);
+
   int flags = RTLD_LOCAL | RTLD_LAZY;
   if (interpreterFile_.customLoader) {
     flags |= RTLD_DEEPBIND;
@@ -258,23 +792,42 @@ Interpreter::Interpreter(
     auto deploySetSelfPtr = (void (*)(void*))dlsym(handle_, "deploy_set_self");
     AT_ASSERT(deploySetSelfPtr);
     deploySetSelfPtr(handle_);
+    // the custom loader of the interpreter shares its caches with the host.
+    auto deploySetLoaderSharedStatePtr =
+        (void (*)(const LoaderSharedState*))dlsym(
+            handle_, "deploy_set_loader_shared_state");
+    AT_ASSERT(deploySetLoaderSharedStatePtr);
+    deploySetLoaderSharedStatePtr(loader_shared_state());
   }
 
   std::vector<std::string> pluginPaths;
-#ifndef FBCODE_CAFFE2
-  torchPluginFile_.emplace(
-      "multipy_torch", multipyTorchSections, multipyTorchSymbols);
-  pluginPaths.emplace_back(torchPluginFile_->libraryName);
-#endif
+  if (torchPluginFile_) {
+    pluginPaths.emplace_back(torchPluginFile_->libraryName);
+  }
+  startupTimings_.load = elapsedSince(phaseBegin);
 
   auto extraPythonPaths = env_->getExtraPythonPaths();
   void* newInterpreterImpl = dlsym(handle_, "newInterpreterImpl");
   AT_ASSERT(newInterpreterImpl);
+  std::unique_lock<std::mutex> serialGuard(serialInitMutex(), std::defer_lock);
+  if (serializeInitialize) {
+    serialGuard.lock();
+  }
   pImpl_ = std::unique_ptr<InterpreterImpl>(
       ((InterpreterImpl *
         (*)(const std::vector<std::string>&, const std::vector<std::string>&))
            newInterpreterImpl)(extraPythonPaths, pluginPaths));
   env_->configureInterpreter(this);
+  startupTimings_.initialize = elapsedSince(phaseBegin);
+  if (interpreterFile_.customLoader) {
+    auto deployLibraryLoadTimingsPtr = (void (*)(LoadTimings*))dlsym(
+        handle_, "deploy_library_load_timings");
+    AT_ASSERT(deployLibraryLoadTimingsPtr);
+    deployLibraryLoadTimingsPtr(&startupTimings_.libraries);
+  }
+  startupTimings_.total =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - begin);
 }
 
 Interpreter::~Interpreter() {
@@ -291,6 +844,111 @@ Interpreter::~Interpreter() {
 }
 
 int LoadBalancer::acquire() {
+  if (policy_ == LoadBalancerPolicy::LeastLoaded) {
+    return acquireLeastLoaded();
+  }
+  // a thread that already holds an interpreter must not wait for another
+  // one, since the interpreter it is waiting for might be the one it holds.
+  int where = acquireFree();
+  if (where < 0) {
+    where = heldBy(std::this_thread::get_id()) > 0 ? acquireLeastLoaded()
+                                                   : acquireQueued();
+  }
+  noteAcquired();
+  return where;
+}
+
+void LoadBalancer::acquireAt(int where) {
+  __atomic_fetch_add(&uses_[8 * where], 1ULL, __ATOMIC_SEQ_CST);
+  if (policy_ == LoadBalancerPolicy::WorkStealing) {
+    noteAcquired();
+  }
+}
+
+size_t LoadBalancer::heldBy(std::thread::id holder) {
+  std::lock_guard<std::mutex> guard(heldMutex_);
+  auto it = held_.find(holder);
+  return it == held_.end() ? 0 : it->second;
+}
+
+void LoadBalancer::noteAcquired() {
+  std::lock_guard<std::mutex> guard(heldMutex_);
+  ++held_[std::this_thread::get_id()];
+}
+
+void LoadBalancer::noteFreed(std::thread::id holder) {
+  std::lock_guard<std::mutex> guard(heldMutex_);
+  auto it = held_.find(holder);
+  if (it == held_.end()) {
+    return;
+  }
+  if (--it->second == 0) {
+    held_.erase(it);
+  }
+}
+
+int LoadBalancer::acquireAmong(
+    const std::vector<int>& candidates,
+    bool shareBusy) {
+  int minIdx = -1;
+  uint64_t minusers = UINT64_MAX;
+  for (int candidate : candidates) {
+    if (static_cast<size_t>(candidate) >= n_) {
+      continue;
+    }
+    uint64_t prev = 0;
+    if (__atomic_compare_exchange_n(
+            &uses_[8 * candidate],
+            &prev,
+            1ULL,
+            false,
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_SEQ_CST)) {
+      minIdx = candidate;
+      minusers = 0;
+      break;
+    }
+    if (prev < minusers) {
+      minusers = prev;
+      minIdx = candidate;
+    }
+  }
+  if (minIdx < 0) {
+    return acquire();
+  }
+  if (minusers > 0) {
+    if (!shareBusy) {
+      return -1;
+    }
+    __atomic_fetch_add(&uses_[8 * minIdx], 1ULL, __ATOMIC_SEQ_CST);
+  }
+  if (policy_ == LoadBalancerPolicy::WorkStealing) {
+    noteAcquired();
+  }
+  return minIdx;
+}
+
+int LoadBalancer::acquireFree() {
+  thread_local int last = 0;
+  for (size_t i = 0; i < n_; ++i, ++last) {
+    if (last >= static_cast<int>(n_)) {
+      last = 0;
+    }
+    uint64_t prev = 0;
+    if (__atomic_compare_exchange_n(
+            &uses_[8 * last],
+            &prev,
+            1ULL,
+            false,
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_SEQ_CST)) {
+      return last;
+    }
+  }
+  return -1;
+}
+
+int LoadBalancer::acquireLeastLoaded() {
   thread_local int last = 0;
   size_t minusers = SIZE_MAX;
   int minIdx = 0;
@@ -325,30 +983,120 @@ int LoadBalancer::acquire() {
   return minIdx;
 }
 
-void LoadBalancer::free(int where) {
+int LoadBalancer::acquireQueued() {
+  std::unique_lock<std::mutex> guard(mutex_);
+  // every interpreter returns to zero users while holding mutex_, so if
+  // nothing is free now, nothing will be until we wait.
+  int where = acquireFree();
+  if (where >= 0) {
+    return where;
+  }
+  size_t shortest = 0;
+  for (size_t i = 1; i < n_; ++i) {
+    if (queues_[i].size() < queues_[shortest].size()) {
+      shortest = i;
+    }
+  }
+  Waiter waiter;
+  queues_[shortest].push_back(&waiter);
+  waiter.cv.wait(guard, [&waiter] { return waiter.where >= 0; });
+  return waiter.where;
+}
+
+LoadBalancer::Waiter* LoadBalancer::popWaiter(int where) {
+  auto* queue = &queues_[where];
+  if (queue->empty()) {
+    // steal from the longest queue so that waiters are served roughly in
+    // the order they arrived across all interpreters.
+    for (auto& other : queues_) {
+      if (other.size() > queue->size()) {
+        queue = &other;
+      }
+    }
+    if (queue->empty()) {
+      return nullptr;
+    }
+  }
+  Waiter* waiter = queue->front();
+  queue->pop_front();
+  return waiter;
+}
+
+void LoadBalancer::beforeFork() {
+  MULTIPY_CHECK(
+      heldBy(std::this_thread::get_id()) == 0,
+      "Cannot fork while the calling thread holds an interpreter");
+  mutex_.lock();
+  heldMutex_.lock();
+}
+
+void LoadBalancer::afterFork(bool child) {
+  if (child) {
+    // the users of the subinterpreters, including waiters, were other threads
+    memset(uses_.get(), 0, 8 * allocated_ * sizeof(uint64_t));
+    for (auto& queue : queues_) {
+      queue.clear();
+    }
+    held_.clear();
+  }
+  heldMutex_.unlock();
+  mutex_.unlock();
+}
+
+void LoadBalancer::free(int where, std::thread::id holder) {
+  if (policy_ == LoadBalancerPolicy::LeastLoaded) {
+    // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers)
+    __atomic_fetch_sub(&uses_[8 * where], 1ULL, __ATOMIC_SEQ_CST);
+    return;
+  }
+  noteFreed(holder);
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (__atomic_load_n(&uses_[8 * where], __ATOMIC_SEQ_CST) == 1 &&
+      static_cast<size_t>(where) < n_) {
+    if (Waiter* waiter = popWaiter(where)) {
+      // hand the interpreter over directly, it never becomes free so a
+      // thread on the fast path cannot take it from the waiter.
+      waiter->where = where;
+      waiter->cv.notify_one();
+      return;
+    }
+  }
   // NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers)
   __atomic_fetch_sub(&uses_[8 * where], 1ULL, __ATOMIC_SEQ_CST);
 }
 
 void PythonMethodWrapper::setArgumentNames(
     std::vector<std::string>& argumentNamesOut) const {
-  auto session = model_.acquireSession();
-  auto method = session.self.attr(methodName_.c_str());
+  ReplicatedObjImpl& impl = *model_.pImpl_;
+  {
+    std::lock_guard<std::mutex> guard(impl.argumentNamesMutex_);
+    auto it = impl.argumentNames_.find(methodName_);
+    if (it != impl.argumentNames_.end()) {
+      argumentNamesOut = it->second;
+      return;
+    }
+  }
+
+  std::vector<std::string> names;
+  auto session = model_.acquireSessionWithoutSelf();
+  auto method = session.methodFromMovable(model_, methodName_);
   auto iArgumentNames =
       session.global("GetArgumentNamesModule", "getArgumentNames")({method})
           .toIValue();
-  if (iArgumentNames.isNone()) {
-    return;
-  }
+  if (!iArgumentNames.isNone()) {
+    TORCH_INTERNAL_ASSERT(iArgumentNames.isList());
+    auto argumentNames = iArgumentNames.toListRef();
 
-  TORCH_INTERNAL_ASSERT(iArgumentNames.isList());
-  auto argumentNames = iArgumentNames.toListRef();
-
-  argumentNamesOut.reserve(argumentNames.size());
-  for (auto& argumentName : argumentNames) {
-    TORCH_INTERNAL_ASSERT(argumentName.isString());
-    argumentNamesOut.push_back(argumentName.toStringRef());
+    names.reserve(argumentNames.size());
+    for (auto& argumentName : argumentNames) {
+      TORCH_INTERNAL_ASSERT(argumentName.isString());
+      names.push_back(argumentName.toStringRef());
+    }
   }
+
+  std::lock_guard<std::mutex> guard(impl.argumentNamesMutex_);
+  argumentNamesOut = impl.argumentNames_.emplace(methodName_, std::move(names))
+                         .first->second;
 }
 
 } // namespace deploy
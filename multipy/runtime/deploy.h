@@ -8,21 +8,29 @@
 #include <c10/util/irange.h>
 #include <multipy/runtime/embedded_file.h>
 #include <multipy/runtime/interpreter/interpreter_impl.h>
+#include <multipy/runtime/loader.h>
 #include <multipy/runtime/noop_environment.h>
 #include <torch/csrc/api/include/torch/imethod.h>
 #include <torch/csrc/jit/serialization/import.h>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace torch {
 namespace deploy {
 
 struct ReplicatedObj;
+struct ReplicatedObjImpl;
 struct InterpreterManager;
 struct LoadBalancer;
 
@@ -65,21 +73,55 @@ struct TORCH_API InterpreterSession {
   /// Converts a `ReplicatedObj` to an `Obj` on this InterpreterSession.
   Obj fromMovable(const ReplicatedObj& obj);
 
+  /// Moves `obj`, which lives in this InterpreterSession, to the session
+  /// `target`, usually on another interpreter. Only the structure of `obj` is
+  /// pickled, the storages of its tensors are shared with the copy. Unlike a
+  /// `ReplicatedObj` the copy is not kept by `target`'s interpreter once it is
+  /// no longer referenced.
+  Obj moveTo(Obj obj, InterpreterSession& target);
+
+  /// Returns the bound method `name` of `obj` on this InterpreterSession. It
+  /// is looked up once per interpreter and cached until `obj` is unloaded.
+  Obj methodFromMovable(const ReplicatedObj& obj, const std::string& name);
+
+  /// Calls each object of `calls` with its arguments, in order, holding the
+  /// GIL once for all of them. A call which fails does not stop the others,
+  /// its error is reported in its `CallResult`.
+  std::vector<CallResult> callMany(
+      at::ArrayRef<std::pair<Obj, at::ArrayRef<at::IValue>>> calls);
+
  protected:
   bool attachDeconstructorCallback(std::function<void()> func);
 
  private:
+  friend class Interpreter;
   friend struct ReplicatedObj;
   friend struct Package;
   friend struct InterpreterManager;
   friend struct ReplicatedObjImpl;
-  inline static size_t nextObjectId_ = 0;
+  inline static std::atomic<int64_t> nextObjectId_{0};
   std::unique_ptr<InterpreterSessionImpl> impl_;
   InterpreterManager* manager_; /// if created from one
+  const Interpreter* interpreter_ = nullptr; /// if acquired from one
   std::function<void()> deconstruction_callback_ = nullptr;
   PickledObject pickleObj(Obj obj);
 };
 
+/// Time spent in each phase of creating an `Interpreter`.
+struct InterpreterStartupTimings {
+  /// writing the embedded libraries to disk
+  std::chrono::microseconds extract{0};
+  /// loading the interpreter library
+  std::chrono::microseconds load{0};
+  /// initializing python, importing torch and configuring the environment
+  std::chrono::microseconds initialize{0};
+  /// wall time of the whole construction, at least the sum of the phases
+  std::chrono::microseconds total{0};
+  /// the part of `initialize` spent by the custom loader loading libraries
+  /// into the interpreter, e.g. libtorch_python.
+  LoadTimings libraries;
+};
+
 /// An `Interpreter` represents an invidual subinterpreter created by
 /// `torch::deploy`. It allows for the creation of `InterpreterSession` objects
 /// which allow users to interact with python objects.
@@ -90,13 +132,33 @@ class TORCH_API Interpreter {
   InterpreterManager* manager_; /// optional if managed by one
   std::shared_ptr<Environment> env_;
 
+  /// a copy of the interpreter image, which is extracted once for all the
+  /// interpreters created together, since dlopen would return the already
+  /// loaded library for the same file. The image itself is only held while
+  /// the copy is made.
   EmbeddedFile interpreterFile_;
-  std::optional<EmbeddedFile> torchPluginFile_;
+  /// loaded by the custom loader, so it is shared by all interpreters.
+  std::shared_ptr<EmbeddedFile> torchPluginFile_;
+  InterpreterStartupTimings startupTimings_;
+
+  /// binds `I` to this interpreter and unloads the replicated objects
+  /// destroyed since it was last acquired, see
+  /// `InterpreterManager::applyPendingUnloads`.
+  void onSessionAcquired(InterpreterSession& I) const;
+
+  /// with `serializeInitialize`, python is initialized in one interpreter at
+  /// a time across all the interpreters created this way.
+  Interpreter(
+      InterpreterManager* manager,
+      std::shared_ptr<Environment> env,
+      std::chrono::steady_clock::time_point begin,
+      bool serializeInitialize = false);
 
  public:
   /// Creates an Interpreter which is managed by `manager` and using the
   /// environment `env`
-  Interpreter(InterpreterManager* manager, std::shared_ptr<Environment> env);
+  Interpreter(InterpreterManager* manager, std::shared_ptr<Environment> env)
+      : Interpreter(manager, env, std::chrono::steady_clock::now()) {}
 
   /// Creates an Interpreter manager using environment `env` which is not tied
   /// to an Interpreter Manager.
@@ -105,11 +167,14 @@ class TORCH_API Interpreter {
 
   /// Gets a new `InterpreterSession` from this Interpreter.
   InterpreterSession acquireSession() const {
-    if (manager_) {
-      return InterpreterSession(pImpl_->acquireSession(), manager_);
-    } else {
-      return InterpreterSession(pImpl_->acquireSession());
-    }
+    InterpreterSession I(pImpl_->acquireSession(), manager_);
+    onSessionAcquired(I);
+    return I;
+  }
+
+  /// Returns how long creating this interpreter took.
+  const InterpreterStartupTimings& startupTimings() const {
+    return startupTimings_;
   }
 
   ~Interpreter();
@@ -117,8 +182,10 @@ class TORCH_API Interpreter {
       : handle_(rhs.handle_),
         pImpl_(std::move(rhs.pImpl_)),
         manager_(rhs.manager_),
+        env_(std::move(rhs.env_)),
         interpreterFile_(std::move(rhs.interpreterFile_)),
-        torchPluginFile_(std::move(rhs.torchPluginFile_)) {
+        torchPluginFile_(std::move(rhs.torchPluginFile_)),
+        startupTimings_(rhs.startupTimings_) {
     rhs.handle_ = nullptr;
   }
 
@@ -130,12 +197,32 @@ class TORCH_API Interpreter {
 
 struct Package;
 
+/// Selects how `LoadBalancer` hands out subinterpreters once all of them are
+/// in use.
+enum class LoadBalancerPolicy {
+  /// Adds the caller to the subinterpreter with the fewest users. The caller
+  /// then waits on that subinterpreter's GIL, even if another one frees up
+  /// first.
+  LeastLoaded,
+  /// Queues the caller on the subinterpreter with the shortest queue. A
+  /// subinterpreter that is freed is handed to a caller from its own queue, or
+  /// steals one from the longest queue of another subinterpreter, so that no
+  /// subinterpreter sits idle while callers are waiting.
+  WorkStealing,
+};
+
 /// The default LoadBalancer for torch::deploy which handles allocating and
 /// freeing subinterpreters.
 struct TORCH_API LoadBalancer {
   /// Creates a Loadbalancer which handles `n` interpreters.
-  explicit LoadBalancer(size_t n)
-      : uses_(new uint64_t[8 * n]), allocated_(n), n_(n) {
+  explicit LoadBalancer(
+      size_t n,
+      LoadBalancerPolicy policy = LoadBalancerPolicy::WorkStealing)
+      : uses_(new uint64_t[8 * n]),
+        allocated_(n),
+        n_(n),
+        policy_(policy),
+        queues_(n) {
     /// 8*... to avoid false sharing of atomics on the same cache line
     memset(uses_.get(), 0, 8 * n_ * sizeof(uint64_t));
   }
@@ -148,40 +235,137 @@ struct TORCH_API LoadBalancer {
   }
 
   /// Allocates an subinterpreter, and return its ID which is used to free it.
+  /// With `LoadBalancerPolicy::WorkStealing` this blocks until a
+  /// subinterpreter is free, unless the calling thread already holds one of
+  /// this load balancer's subinterpreters, in which case it falls back to
+  /// `LoadBalancerPolicy::LeastLoaded` to avoid deadlocking on itself.
   int acquire();
 
+  /// Allocates a subinterpreter among the IDs in `candidates`, preferring one
+  /// with no users. If all of them are in use, returns -1 when `shareBusy` is
+  /// false, and otherwise the candidate with the fewest users. Candidates
+  /// outside the resource limit are ignored, and if none is left this behaves
+  /// like `LoadBalancer::acquire()`.
+  int acquireAmong(const std::vector<int>& candidates, bool shareBusy);
+
+  /// Marks the subinterpreter with ID `where` as used, regardless of how many
+  /// users it already has. It is freed with `LoadBalancer::free(where)`.
+  void acquireAt(int where);
+
   /// Frees the subinterpreter with ID `where`. This ID is returned by
-  /// `LoadBalancer::acquire()`
-  void free(int where);
+  /// `LoadBalancer::acquire()`. `holder` is the thread which acquired it, which
+  /// differs from the calling thread when its session was moved to another
+  /// thread.
+  void free(int where, std::thread::id holder = std::this_thread::get_id());
+
+  /// Called by `InterpreterManager::fork()` around fork(). In the child, every
+  /// subinterpreter is marked free, since the threads using them are gone.
+  void beforeFork();
+  void afterFork(bool child);
+
+  /// Returns the policy used when all subinterpreters are in use.
+  LoadBalancerPolicy policy() const {
+    return policy_;
+  }
 
  private:
+  /// A caller blocked in `acquire()`, `where` is set by `free()` once a
+  /// subinterpreter has been handed to it.
+  struct Waiter {
+    int where = -1;
+    std::condition_variable cv;
+  };
+
+  /// Claims a subinterpreter with no users, returns -1 if there is none.
+  int acquireFree();
+  int acquireLeastLoaded();
+  int acquireQueued();
+  /// Pops the next waiter to hand subinterpreter `where` to, preferring
+  /// `where`'s own queue. Must be called with `mutex_` held.
+  Waiter* popWaiter(int where);
+  /// Number of subinterpreters held by the thread `holder`, see `acquire()`.
+  size_t heldBy(std::thread::id holder);
+  void noteAcquired();
+  void noteFreed(std::thread::id holder);
+
   // NOLINTNEXTLINE(modernize-avoid-c-arrays,cppcoreguidelines-avoid-c-arrays)
   std::unique_ptr<uint64_t[]>
       uses_; /// the approximate count of the number of users of interpreter
   size_t allocated_;
   size_t n_;
+  LoadBalancerPolicy policy_;
+  /// guards `queues_` and, for `LoadBalancerPolicy::WorkStealing`, the
+  /// transition of `uses_` from 1 to 0 in `free()`.
+  std::mutex mutex_;
+  std::vector<std::deque<Waiter*>> queues_;
+  /// for `LoadBalancerPolicy::WorkStealing`, the number of subinterpreters
+  /// held by each thread which holds any. Kept per acquiring thread rather
+  /// than in a thread_local, so that a session freed on another thread is
+  /// still accounted to the thread which acquired it.
+  std::mutex heldMutex_;
+  std::unordered_map<std::thread::id, size_t> held_;
+};
+
+/// Selects how `InterpreterManager` creates its subinterpreters.
+enum class InterpreterInitMode {
+  /// One after the other, on the thread constructing the manager.
+  Serial,
+  /// Concurrently, one thread per core. The `Environment` and the extension
+  /// modules imported while initializing python must support configuring
+  /// several subinterpreters at once.
+  Parallel,
+  /// Extracts and loads the subinterpreters concurrently like `Parallel`, but
+  /// initializes python in one subinterpreter at a time.
+  ParallelLoad,
 };
 
 /// An `InterpreterManager` handles the interaction of multiple subinterpreters
 /// such as allocating subinterpreters, or load balancing the subinterpreters.
 struct TORCH_API InterpreterManager {
   /// constructor for `InterpreterManager` which takes the number of
-  /// interpreters (usually correlates to number of cores on your cpu), and a
-  /// pointer to an `Environment`. The default uses the local python env.
+  /// interpreters (usually correlates to number of cores on your cpu), a
+  /// pointer to an `Environment`, the policy used to hand out interpreters
+  /// when they are all in use and how the interpreters are created. The
+  /// default uses the local python env.
   explicit InterpreterManager(
       size_t nInterp = 2,
-      std::shared_ptr<Environment> env = std::make_shared<NoopEnvironment>());
-
-  /// Returns a free interpreter or an arbitrary interpreter if there are
-  /// none free. To ensure data safety it's best to match the number of
-  /// calling threads to the size of the interpreter pool to avoid
-  /// sharing an interpreter.
+      std::shared_ptr<Environment> env = std::make_shared<NoopEnvironment>(),
+      LoadBalancerPolicy policy = LoadBalancerPolicy::WorkStealing,
+      InterpreterInitMode initMode = InterpreterInitMode::Serial);
+
+  /// Returns a free interpreter. If there are none free, the behavior depends
+  /// on the `LoadBalancerPolicy` given at construction: `WorkStealing` waits
+  /// for the first interpreter to be freed, `LeastLoaded` returns the
+  /// interpreter with the fewest users. To ensure data safety it's best to
+  /// match the number of calling threads to the size of the interpreter pool
+  /// to avoid sharing an interpreter.
   InterpreterSession acquireOne() {
-    int where = resources_.acquire();
-    InterpreterSession I = instances_[where].acquireSession();
-    I.attachDeconstructorCallback(
-        [this, where]() -> void { resources_.free(where); });
-    return I;
+    return acquiredSession(resources_.acquire());
+  }
+
+  /// Unloads now the replicated objects which were destroyed but not yet
+  /// unloaded from the interpreters, instead of waiting for each interpreter
+  /// to be acquired again. This may wait for calls running on them.
+  void collect();
+
+  /// Runs every call of `calls` on a single interpreter in one session, see
+  /// `InterpreterSession::callMany`. This avoids acquiring a session and the
+  /// GIL per call when fanning out many small calls.
+  std::vector<CallResult> callMany(
+      at::ArrayRef<std::pair<ReplicatedObj, std::vector<at::IValue>>> calls);
+
+  /// Returns the wall time taken to create all interpreters. The time taken by
+  /// each one is available from `Interpreter::startupTimings()`.
+  std::chrono::microseconds startupTime() const {
+    return startupTime_;
+  }
+
+  /// Returns how many bytes of relocated library pages the custom loader
+  /// mapped from an existing copy instead of duplicating them, see
+  /// `LoaderOptions::share_pages`. The count covers every library loaded in
+  /// the process, not only by the interpreters of this manager.
+  size_t sharedLibraryBytesSaved() const {
+    return CustomLibrary::shared_bytes_saved();
   }
 
   /// use to make sure something gets run on all interpreters, such as loading
@@ -221,35 +405,162 @@ struct TORCH_API InterpreterManager {
   }
 
   /// Converts `obj` from on `InterpreterSession` I into a  `ReplicatedObj`.
-  ReplicatedObj createMovable(Obj obj, InterpreterSession* I);
+  /// With `deduplicate`, an object whose pickle and tensor storages are
+  /// identical to those of a live deduplicated `ReplicatedObj` of this manager
+  /// returns that `ReplicatedObj` instead, so both share a single unpickled
+  /// instance on each interpreter.
+  ReplicatedObj createMovable(
+      Obj obj,
+      InterpreterSession* I,
+      bool deduplicate = false);
+
+  /// Forks the process once every interpreter is in a consistent state, and
+  /// returns the result of fork(). The child gets a copy of all interpreters,
+  /// loaded packages and replicated objects, with memory shared copy-on-write
+  /// with the parent, so it can serve requests without initializing python.
+  ///
+  /// This waits until no other thread runs python on any interpreter and
+  /// blocks them until the fork is done. Threads do not survive fork, so:
+  /// - the calling thread must not hold an `InterpreterSession`, and no
+  ///   thread may hold sessions on several interpreters at once,
+  /// - `submit` must not have been used, since it starts worker threads,
+  /// - CUDA must not have been initialized, as it cannot be used in the child,
+  /// - objects used by other threads at the time of the fork must not be
+  ///   relied upon in the child.
+  /// Temporary files are only removed by the process which created them. The
+  /// state shared by all managers, such as the registries of the custom
+  /// loader, is locked across every fork() made once a manager exists.
+  pid_t fork();
+
+  /// Unpickles `obj` on every interpreter concurrently, one thread per
+  /// interpreter, so that the first calls made on each interpreter do not pay
+  /// for it. Returns the time taken on each interpreter, indexed like
+  /// `allInstances()`. If unpickling fails on any interpreter the first error
+  /// is rethrown once all threads are done.
+  std::vector<std::chrono::microseconds> replicateEverywhere(
+      const ReplicatedObj& obj);
+
+  /// Invokes `obj` with arguments `args` and named arguments `kwargs`
+  /// asynchronously and returns a future holding the result, or the error
+  /// raised by the call. Calls are run by a pool of worker threads, one per
+  /// interpreter, which is started by the first call to `submit`. This lets a
+  /// few threads keep every interpreter busy without holding an
+  /// `InterpreterSession` themselves.
+  c10::intrusive_ptr<c10::ivalue::Future> submit(
+      ReplicatedObj obj,
+      std::vector<at::IValue> args,
+      std::unordered_map<std::string, c10::IValue> kwargs = {});
+
   InterpreterManager(const InterpreterManager&) = delete;
   InterpreterManager& operator=(const InterpreterManager&) = delete;
   InterpreterManager& operator=(InterpreterManager&&) = delete;
+  // NOLINTNEXTLINE(bugprone-exception-escape)
+  ~InterpreterManager();
 
  private:
   friend struct Package;
+  friend class Interpreter;
   friend struct InterpreterSession;
   friend struct InterpreterSessionImpl;
+  friend struct ReplicatedObj;
+  friend struct ReplicatedObjImpl;
+  /// Opens a session on interpreter `where`, which was allocated from
+  /// `resources_` and is freed when the session is destroyed.
+  InterpreterSession acquiredSession(int where) {
+    InterpreterSession I = instances_[where].acquireSession();
+    I.attachDeconstructorCallback(
+        [this, where, holder = std::this_thread::get_id()]() -> void {
+          resources_.free(where, holder);
+        });
+    return I;
+  }
+  void startWorkers();
+  void runWorker(size_t where);
+  /// Queues unloading object `id` from the interpreters flagged in `loadedOn`,
+  /// see `applyPendingUnloads`.
+  void queueUnload(int64_t id, const std::vector<std::atomic<bool>>& loadedOn);
+  /// Unloads the objects queued for `interp` using its new session `I`.
+  void applyPendingUnloads(const Interpreter* interp, InterpreterSession& I);
   std::vector<Interpreter> instances_;
+  std::chrono::microseconds startupTime_{0};
   LoadBalancer resources_;
   std::unordered_map<std::string, std::string> registeredModuleSource_;
+
+  /// state of the worker threads used by `submit`, each worker runs tasks on
+  /// its own interpreter.
+  std::once_flag workersStarted_;
+  std::mutex tasksMutex_;
+  std::condition_variable tasksAvailable_;
+  std::deque<std::function<void(const Interpreter*)>> tasks_;
+  bool stopWorkers_ = false;
+  std::vector<std::thread> workers_;
+
+  /// ids of the replicated objects destroyed since each interpreter was last
+  /// acquired, indexed like `instances_`.
+  std::mutex pendingUnloadsMutex_;
+  std::vector<std::vector<int64_t>> pendingUnloads_;
+  std::unique_ptr<std::atomic<bool>[]> hasPendingUnloads_;
+
+  /// live replicated objects by content hash, see `createMovable`.
+  std::mutex movablesMutex_;
+  std::unordered_multimap<size_t, std::weak_ptr<ReplicatedObjImpl>> movables_;
+};
+
+/// Controls which interpreters `ReplicatedObj::acquireSession` runs an object
+/// on when no interpreter is given. Each interpreter an object runs on keeps
+/// its own unpickled replica, so this trades memory for fewer cold calls.
+enum class ReplicaAffinityPolicy {
+  /// Any interpreter picked by the load balancer, so the object is eventually
+  /// replicated on every interpreter.
+  Any,
+  /// Only the `maxReplicas` interpreters assigned to the object. When all of
+  /// them are busy the caller shares the least loaded one.
+  Pinned,
+  /// A free interpreter which already holds a replica. When all of them are
+  /// busy the call spills to any interpreter, creating a new replica, unless
+  /// `maxReplicas` replicas exist already (0 means no limit), in which case
+  /// the caller shares the least loaded replica.
+  PreferLoaded,
+};
+
+struct ReplicaAffinity {
+  ReplicaAffinityPolicy policy = ReplicaAffinityPolicy::Any;
+  size_t maxReplicas = 0;
 };
 
 struct TORCH_API ReplicatedObjImpl {
   ReplicatedObjImpl(
       size_t object_id,
-      // NOLINTNEXTLINE(modernize-pass-by-value)
       PickledObject data,
       InterpreterManager* manager)
-      : objectId_(object_id), data_(data), manager_(manager) {}
-  // NOLINTNEXTLINE(bugprone-exception-escape)
+      : objectId_(object_id),
+        data_(std::move(data)),
+        manager_(manager),
+        loadedOn_(manager ? manager->allInstances().size() : 0) {}
+  /// Queues the unloading of this object on the interpreters which loaded it,
+  /// so that dropping the last `ReplicatedObj` never blocks, see
+  /// `InterpreterManager::applyPendingUnloads`.
   ~ReplicatedObjImpl();
   void unload(const Interpreter* onThisInterpreter);
+  /// Allocates an interpreter from the manager according to `affinity_`.
+  int acquireInterpreter();
+  /// Records whether `interp` holds an unpickled replica of this object.
+  void setLoaded(const Interpreter* interp, bool loaded);
   int64_t objectId_;
   PickledObject data_;
   InterpreterManager* manager_;
+  ReplicaAffinity affinity_;
+  /// approximate record of the interpreters holding a replica, indexed like
+  /// `InterpreterManager::allInstances()`.
+  std::vector<std::atomic<bool>> loadedOn_;
+  /// argument names of the methods of this object, see
+  /// `PythonMethodWrapper::setArgumentNames`.
+  std::mutex argumentNamesMutex_;
+  std::unordered_map<std::string, std::vector<std::string>> argumentNames_;
 };
 
+class BoundCall;
+
 /// ReplicatedObj represents a python object that can be used on multiple
 /// interpreters. Calling methods on this will pick an arbitrary interpreter
 /// to run on, transfer it there if not already and run the method. A
@@ -294,6 +605,21 @@ struct TORCH_API ReplicatedObj {
     return I.self.hasattr(attr);
   }
 
+  /// Binds the method `methodName` of this object, or the object itself if
+  /// `methodName` is empty, to a declared `signature`. Calls through the
+  /// returned `BoundCall` pass keyword arguments by position instead of by
+  /// name, so they do not build a kwargs map or dictionary.
+  BoundCall bind(CallSignature signature, std::string methodName = "") const;
+
+  /// Unpickles this object on every interpreter of its manager ahead of time,
+  /// see `InterpreterManager::replicateEverywhere`.
+  std::vector<std::chrono::microseconds> warmup() const;
+
+  /// Sets the policy used to choose an interpreter when `acquireSession` is
+  /// called without one. It is shared by all copies of this `ReplicatedObj`
+  /// and should be set before the object is used from several threads.
+  void setAffinity(ReplicaAffinity affinity);
+
   /// Deletes `ReplicatedObj` from onThisInterpreter, if onThisInterpreter is
   /// `nullptr`, unload is called on all interpreters belonging to the
   /// ReplicatedObject's InterpreterManager
@@ -305,12 +631,41 @@ struct TORCH_API ReplicatedObj {
  private:
   ReplicatedObj(std::shared_ptr<ReplicatedObjImpl> pImpl)
       : pImpl_(std::move(pImpl)) {}
+  /// Like `acquireSession` but leaves `self` unset, for callers which only
+  /// need a method of this object.
+  InterpreterSession acquireSessionWithoutSelf(
+      const Interpreter* onThisInterpreter = nullptr) const;
   std::shared_ptr<ReplicatedObjImpl> pImpl_;
+  friend class BoundCall;
+  friend class PythonMethodWrapper;
   friend struct Package;
   friend struct InterpreterSession;
   friend struct InterpreterManager;
 };
 
+/// BoundCall calls a `ReplicatedObj` with a signature declared once, see
+/// `ReplicatedObj::bind`. The keyword names of the signature are interned by
+/// each interpreter the first time it is called there and the call uses
+/// python's vectorcall protocol where available.
+class TORCH_API BoundCall {
+ public:
+  /// Calls the bound method on an arbitrary interpreter. `args` holds the
+  /// values of the positional arguments of the signature followed by those of
+  /// its keyword arguments, each checked against its declared kind.
+  at::IValue operator()(at::ArrayRef<at::IValue> args) const;
+
+  const CallSignature& signature() const {
+    return *signature_;
+  }
+
+ private:
+  BoundCall(ReplicatedObj obj, std::string methodName, CallSignature signature);
+  ReplicatedObj obj_;
+  std::string methodName_;
+  std::shared_ptr<const CallSignature> signature_;
+  friend struct ReplicatedObj;
+};
+
 /// PythonMethodWrapper is a more specific instance of a
 /// ReplicatedObj which represents a python method, and
 /// is therefore callable and has argument names accessible.
@@ -332,10 +687,10 @@ class PythonMethodWrapper : public torch::IMethod {
   c10::IValue operator()(
       std::vector<c10::IValue> args,
       const IValueMap& kwargs = IValueMap()) const override {
-    // TODO(whc) ideally, pickle the method itself as replicatedobj, to skip
-    // this lookup each time
-    auto modelSession = model_.acquireSession();
-    auto method = modelSession.self.attr(methodName_.c_str());
+    // the bound method is cached by each interpreter, so only the first call
+    // on an interpreter looks it up.
+    auto modelSession = model_.acquireSessionWithoutSelf();
+    auto method = modelSession.methodFromMovable(model_, methodName_);
     return method.callKwargs(args, kwargs).toIValue();
   }
 
@@ -391,9 +746,13 @@ struct TORCH_API Package {
     return I;
   }
 
-  /// Converts an `Obj` from `InterpreterSession` `I` into a `ReplicatedObj`.
-  ReplicatedObj createMovable(Obj obj, InterpreterSession* I) {
-    return manager_->createMovable(obj, I);
+  /// Converts an `Obj` from `InterpreterSession` `I` into a `ReplicatedObj`,
+  /// see `InterpreterManager::createMovable`.
+  ReplicatedObj createMovable(
+      Obj obj,
+      InterpreterSession* I,
+      bool deduplicate = false) {
+    return manager_->createMovable(obj, I, deduplicate);
   }
 
  private:
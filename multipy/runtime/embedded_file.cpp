@@ -5,26 +5,231 @@
 // LICENSE file in the root directory of this source tree.
 
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <linux/fs.h>
 #include <multipy/runtime/Exception.h>
 #include <multipy/runtime/elf_file.h>
 #include <multipy/runtime/embedded_file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <torch/cuda.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <mutex>
 #include <optional>
+#include <unordered_map>
 
 namespace torch {
 namespace deploy {
 
+namespace {
+// Makes `dst` share the extents of `src`, so no data is copied. Only works
+// between files of the same filesystem, and only where it supports reflinks.
+bool reflinkFile(int src, int dst) {
+#ifdef FICLONE
+  return ioctl(dst, FICLONE, src) == 0;
+#else
+  return false;
+#endif
+}
+
+// Copies all of `src` into `dst`, returns false if the copy failed.
+bool copyFile(int src, int dst) {
+  if (reflinkFile(src, dst)) {
+    return true;
+  }
+  // NOLINTNEXTLINE
+  struct stat st;
+  if (fstat(src, &st) != 0) {
+    return false;
+  }
+  off_t remaining = st.st_size;
+#ifdef __NR_copy_file_range
+  // glibc only wraps copy_file_range since 2.27.
+  while (remaining > 0) {
+    ssize_t copied = syscall(
+        __NR_copy_file_range, src, nullptr, dst, nullptr, remaining, 0);
+    if (copied <= 0) {
+      break;
+    }
+    remaining -= copied;
+  }
+#endif
+  // copy_file_range is not supported between all filesystems and kernels,
+  // sendfile still keeps the copy in the kernel.
+  while (remaining > 0) {
+    ssize_t copied = sendfile(dst, src, nullptr, remaining);
+    if (copied <= 0) {
+      return false;
+    }
+    remaining -= copied;
+  }
+  return true;
+}
+
+// dlopen matches already loaded libraries by path before looking at the file,
+// and descriptor numbers, hence /proc/self/fd paths, get reused.
+bool isLoadedPath(const std::string& path) {
+  void* handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  if (handle) {
+    dlclose(handle);
+    return true;
+  }
+  return false;
+}
+} // namespace
+
+bool fileHasContents(const std::string& path, const char* data, size_t size) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  // NOLINTNEXTLINE
+  struct stat st;
+  bool same = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size;
+  if (same && size > 0) {
+    void* contents = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    same = contents != MAP_FAILED && memcmp(contents, data, size) == 0;
+    if (contents != MAP_FAILED) {
+      munmap(contents, size);
+    }
+  }
+  close(fd);
+  return same;
+}
+
+namespace {
+// guards the files shared by extractOnce.
+std::mutex& extractOnceMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+} // namespace
+
+const std::string& payloadCacheDir() {
+  static const std::string dir = [] {
+    const char* env = getenv("MULTIPY_CACHE_DIR");
+    if (!env || !*env) {
+      return std::string();
+    }
+    if (mkdir(env, 0755) != 0 && errno != EEXIST) {
+      return std::string();
+    }
+    return std::string(env);
+  }();
+  return dir;
+}
+
+std::string payloadHash(const char* data, size_t size) {
+  // a fast non-cryptographic hash, cache entries are also keyed by size and
+  // their contents are compared before they are used.
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+  auto mix = [&h](uint64_t word) {
+    h ^= word;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  };
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    memcpy(&word, data + i, sizeof(word));
+    mix(word);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, size - i);
+  mix(tail);
+  char digest[17];
+  snprintf(digest, sizeof(digest), "%016llx", (unsigned long long)h);
+  return digest;
+}
+
+std::string cachePayload(
+    const std::string& name,
+    const char* data,
+    size_t size) {
+  const std::string& dir = payloadCacheDir();
+  if (dir.empty()) {
+    return "";
+  }
+  std::string entry = name;
+  std::replace(entry.begin(), entry.end(), '/', '_');
+  std::string path = dir + "/" + entry + "-" + payloadHash(data, size) + "-" +
+      std::to_string(size);
+  // the hash can collide and an entry can be damaged after it was written,
+  // so an existing entry is only used if it holds the payload. Otherwise it
+  // is replaced, which does not affect processes that already loaded it.
+  if (fileHasContents(path, data, size)) {
+    return path;
+  }
+
+  std::string tmpPath = dir + "/." + entry + ".XXXXXX";
+  int fd = mkstemp(&tmpPath[0]);
+  if (fd == -1) {
+    return "";
+  }
+  bool ok = fchmod(fd, 0755) == 0;
+  const char* remaining = data;
+  size_t left = size;
+  while (ok && left > 0) {
+    ssize_t written = write(fd, remaining, left);
+    ok = written > 0;
+    if (ok) {
+      remaining += written;
+      left -= written;
+    }
+  }
+  // the entry must be complete on disk before it becomes visible under its
+  // final name.
+  ok = ok && fsync(fd) == 0;
+  close(fd);
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    unlink(tmpPath.c_str());
+    return "";
+  }
+  return path;
+}
+
+bool useMemFd() {
+  static const bool enabled = [] {
+    const char* env = getenv("MULTIPY_DISABLE_MEMFD");
+    return !(env && std::string(env) == "1");
+  }();
+  return enabled;
+}
+
+std::string memFdPath(int fd) {
+  return "/proc/self/fd/" + std::to_string(fd);
+}
+
+int createMemFd(const std::string& name, const char* data, size_t size) {
+  if (!useMemFd()) {
+    return -1;
+  }
+  int fd = memfdCreate(("multipy_" + name).c_str());
+  if (fd == -1) {
+    return -1;
+  }
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written <= 0) {
+      close(fd);
+      return -1;
+    }
+    data += written;
+    size -= written;
+  }
+  return fd;
+}
+
 EmbeddedFile::EmbeddedFile(
     std::string name,
     const std::initializer_list<ExeSection>& sections,
-    const std::initializer_list<InterpreterSymbol> symbols)
-    : libraryName("/tmp/multipy_" + name + "XXXXXX") {
-  int fd = mkstemp(&libraryName[0]);
-  MULTIPY_INTERNAL_ASSERT(fd != -1, "failed to create temporary file");
-  FILE* dst = fdopen(fd, "wb");
-  MULTIPY_INTERNAL_ASSERT(dst);
-
+    const std::initializer_list<InterpreterSymbol> symbols) {
   const char* payloadStart = nullptr;
   size_t size = 0;
   // payloadSection needs to be kept to ensure the source file is still mapped.
@@ -61,14 +266,114 @@ EmbeddedFile::EmbeddedFile(
     size = libEnd - libStart;
     payloadStart = libStart;
   }
+
+  std::string cachedPath = cachePayload(name, payloadStart, size);
+  if (!cachedPath.empty()) {
+    libraryName = std::move(cachedPath);
+    cached = true;
+    return;
+  }
+
+  fd = createMemFd(name, payloadStart, size);
+  if (fd != -1 && !isLoadedPath(memFdPath(fd))) {
+    libraryName = memFdPath(fd);
+    return;
+  }
+  if (fd != -1) {
+    close(fd);
+    fd = -1;
+  }
+
+  libraryName = "/tmp/multipy_" + name + "XXXXXX";
+  int tmp = mkstemp(&libraryName[0]);
+  MULTIPY_INTERNAL_ASSERT(tmp != -1, "failed to create temporary file");
+  FILE* dst = fdopen(tmp, "wb");
+  MULTIPY_INTERNAL_ASSERT(dst);
   size_t written = fwrite(payloadStart, 1, size, dst);
   MULTIPY_INTERNAL_ASSERT(size == written, "expected written == size");
 
   fclose(dst);
 }
 
+EmbeddedFile::EmbeddedFile(std::string name, const EmbeddedFile& source)
+    : customLoader(source.customLoader) {
+  int src = open(source.libraryName.c_str(), O_RDONLY);
+  MULTIPY_INTERNAL_ASSERT(src != -1, "failed to open " + source.libraryName);
+  // A memory file can never share its pages with another one, so a source
+  // on disk is first cloned into a file next to it. This only costs metadata
+  // where the filesystem supports reflinks, e.g. a MULTIPY_CACHE_DIR on btrfs
+  // or XFS.
+  if (source.fd == -1) {
+    std::string dir = source.libraryName.substr(
+        0, source.libraryName.find_last_of('/') + 1);
+    libraryName = dir + ".multipy_" + name + "XXXXXX";
+    int dst = mkstemp(&libraryName[0]);
+    bool cloned = dst != -1 && reflinkFile(src, dst);
+    if (dst != -1) {
+      close(dst);
+    }
+    if (cloned) {
+      close(src);
+      return;
+    }
+    if (dst != -1) {
+      unlink(libraryName.c_str());
+    }
+    libraryName.clear();
+  }
+  int dst = -1;
+  if (useMemFd()) {
+    fd = memfdCreate(("multipy_" + name).c_str());
+    if (fd != -1 && !isLoadedPath(memFdPath(fd))) {
+      libraryName = memFdPath(fd);
+      dst = fd;
+    } else if (fd != -1) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (dst == -1) {
+    libraryName = "/tmp/multipy_" + name + "XXXXXX";
+    dst = mkstemp(&libraryName[0]);
+    MULTIPY_INTERNAL_ASSERT(dst != -1, "failed to create temporary file");
+  }
+  bool copied = copyFile(src, dst);
+  close(src);
+  if (dst != fd) {
+    close(dst);
+  }
+  MULTIPY_INTERNAL_ASSERT(copied, "failed to copy " + source.libraryName);
+}
+
+std::shared_ptr<EmbeddedFile> EmbeddedFile::extractOnce(
+    const std::string& name,
+    const std::initializer_list<ExeSection>& sections,
+    const std::initializer_list<InterpreterSymbol> symbols) {
+  static std::unordered_map<std::string, std::weak_ptr<EmbeddedFile>> files;
+  std::lock_guard<std::mutex> guard(extractOnceMutex());
+  auto& cached = files[name];
+  auto file = cached.lock();
+  if (!file) {
+    file = std::make_shared<EmbeddedFile>(name, sections, symbols);
+    cached = file;
+  }
+  return file;
+}
+
+void EmbeddedFile::lockForFork() {
+  extractOnceMutex().lock();
+}
+
+void EmbeddedFile::unlockAfterFork() {
+  extractOnceMutex().unlock();
+}
+
 EmbeddedFile::~EmbeddedFile() {
-  unlink(libraryName.c_str());
+  if (fd != -1) {
+    close(fd);
+  } else if (!cached && !libraryName.empty() && getpid() == ownerPid) {
+    unlink(libraryName.c_str());
+  }
 }
 
 } // namespace deploy
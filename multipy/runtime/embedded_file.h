@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <unistd.h>
+#include <memory>
 #include <string>
 
 namespace torch {
@@ -26,17 +28,96 @@ struct InterpreterSymbol {
   bool customLoader;
 };
 
+/// Returns true if embedded payloads are kept in anonymous memory files
+/// created with memfd_create instead of being written to /tmp. Setting
+/// MULTIPY_DISABLE_MEMFD=1 turns this off.
+bool useMemFd();
+
+/// Creates an anonymous memory file named `name` holding `size` bytes from
+/// `data`, and returns its descriptor. Returns -1 if memory files are disabled
+/// or not supported, in which case callers should fall back to a temporary
+/// file. The file can be opened by path as `memFdPath(fd)`.
+int createMemFd(const std::string& name, const char* data, size_t size);
+
+/// Returns the path through which the memory file `fd` can be opened.
+std::string memFdPath(int fd);
+
+/// Returns the directory set with MULTIPY_CACHE_DIR, in which extracted
+/// payloads are kept across process restarts, or an empty string if this
+/// opt-in cache is not enabled.
+const std::string& payloadCacheDir();
+
+/// Returns a hex digest of `size` bytes at `data`, used to name the entries of
+/// the payload cache. It is not collision resistant, so the contents of an
+/// entry have to be checked with `fileHasContents` before it is used.
+std::string payloadHash(const char* data, size_t size);
+
+/// Returns true if the file at `path` holds exactly `size` bytes from `data`.
+bool fileHasContents(const std::string& path, const char* data, size_t size);
+
+/// Returns the path of the payload cache entry holding `size` bytes from
+/// `data`, writing it first if it is not there yet or does not hold exactly
+/// these bytes. Entries are written to a temporary file renamed into place,
+/// so processes populating the cache concurrently never see a partial entry.
+/// Returns an empty string if the cache is not enabled or the entry could not
+/// be written.
+std::string cachePayload(const std::string& name, const char* data, size_t size);
+
 /// EmbeddedFile makes it easier to load a custom interpreter embedded within
-/// the binary.
+/// the binary. The payload is taken from the payload cache when it is enabled,
+/// otherwise it is written to a memory file when possible, and to a temporary
+/// file in /tmp if not; `libraryName` is the path to load it from in all
+/// cases. Cached files are shared by every user, so a library loaded with
+/// dlopen has to be copied with `EmbeddedFile(name, source)` first.
 struct EmbeddedFile {
   std::string libraryName{""};
   bool customLoader{false};
+  /// descriptor of the memory file holding the payload, or -1 if it was
+  /// written to a temporary file.
+  int fd{-1};
+  /// true if `libraryName` is an entry of the payload cache, which is kept.
+  bool cached{false};
+  /// only the process which created a temporary file removes it, not the
+  /// children forked from it.
+  pid_t ownerPid{getpid()};
 
   EmbeddedFile(
       std::string name,
       const std::initializer_list<ExeSection>& sections,
       const std::initializer_list<InterpreterSymbol> symbols);
 
+  /// Creates a new file with the same contents as `source`. A source on disk
+  /// is reflinked into a file next to it where the filesystem supports it, so
+  /// the copies share their extents. Otherwise the copy is made by the kernel
+  /// into a memory file, or a temporary file, and takes as much memory or disk
+  /// as the payload itself.
+  EmbeddedFile(std::string name, const EmbeddedFile& source);
+
+  /// Returns the file extracted for `name`, extracting it only if no other
+  /// user currently holds it. Files loaded with the custom loader, which maps
+  /// them privately rather than going through dlopen, can be shared this way
+  /// so that their pages are shared between interpreters as well.
+  static std::shared_ptr<EmbeddedFile> extractOnce(
+      const std::string& name,
+      const std::initializer_list<ExeSection>& sections,
+      const std::initializer_list<InterpreterSymbol> symbols);
+
+  /// Hold the lock of `extractOnce` across fork(), so that the child does not
+  /// inherit it locked by a thread that no longer exists.
+  static void lockForFork();
+  static void unlockAfterFork();
+
+  /// Takes over removing the file from `other`.
+  EmbeddedFile(EmbeddedFile&& other) noexcept
+      : libraryName(std::move(other.libraryName)),
+        customLoader(other.customLoader),
+        fd(other.fd),
+        cached(other.cached),
+        ownerPid(other.ownerPid) {
+    other.libraryName.clear();
+    other.fd = -1;
+  }
+
   ~EmbeddedFile();
 
   EmbeddedFile& operator=(const EmbeddedFile&) = delete;
@@ -7,7 +7,10 @@
 #pragma once
 #include <multipy/runtime/Exception.h>
 #include <multipy/runtime/elf_file.h>
+#include <multipy/runtime/embedded_file.h>
+#include <unistd.h>
 #include <string>
+#include <vector>
 
 namespace torch {
 namespace deploy {
@@ -24,6 +27,11 @@ class Environment {
   // all zipped python libraries will be written
   // under this directory
   std::string extraPythonLibrariesDir_;
+  // memory files holding the zipped python libraries, if any
+  std::vector<int> zippedArchiveFds_;
+  // only the process which created the environment removes its files, not
+  // the children forked from it.
+  pid_t ownerPid_{getpid()};
   std::string getZippedArchive(
       const char* zipped_torch_name,
       const std::string& pythonAppDir) {
@@ -34,6 +42,18 @@ class Environment {
     const char* zippedTorchStart = zippedTorchSection->start;
     auto zippedTorchSize = zippedTorchSection->len;
 
+    std::string cached =
+        cachePayload(zipped_torch_name, zippedTorchStart, zippedTorchSize);
+    if (!cached.empty()) {
+      return cached;
+    }
+
+    int fd = createMemFd(zipped_torch_name, zippedTorchStart, zippedTorchSize);
+    if (fd != -1) {
+      zippedArchiveFds_.push_back(fd);
+      return memFdPath(fd);
+    }
+
     std::string zipArchive = pythonAppDir;
     auto zippedFile = fopen(zipArchive.c_str(), "wb");
     MULTIPY_CHECK(
@@ -80,6 +100,12 @@ class Environment {
   }
 
   virtual ~Environment() {
+    for (int fd : zippedArchiveFds_) {
+      close(fd);
+    }
+    if (getpid() != ownerPid_) {
+      return;
+    }
     auto rmCmd = "rm -rf " + extraPythonLibrariesDir_;
     (void)system(rmCmd.c_str());
   }
@@ -4,6 +4,7 @@
 // This source code is licensed under the BSD-style license found in the
 // LICENSE file in the root directory of this source tree.
 
+#include <multipy/runtime/batching.h>
 #include <multipy/runtime/deploy.h>
 
 #include <ATen/ATen.h>
@@ -18,6 +19,7 @@
 #include <cassert>
 #include <chrono>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <thread>
 #include <vector>
@@ -90,6 +92,18 @@ struct RunPython {
   const torch::deploy::Interpreter* interps_;
 };
 
+struct RunBatched {
+  RunBatched(torch::deploy::Package& package, size_t max_batch_size)
+      : obj_(std::make_shared<torch::deploy::BatchedObj>(
+            RunPython::load_and_wrap(package),
+            torch::deploy::BatchingOptions{max_batch_size})) {}
+  void operator()(int i, std::vector<at::IValue> eg) {
+    (*obj_)(eg);
+  }
+  // BatchedObj is not copyable but std::function requires it
+  std::shared_ptr<torch::deploy::BatchedObj> obj_;
+};
+
 static torch::IValue to_device(const torch::IValue& v, torch::Device to);
 
 static std::vector<torch::IValue> to_device_vec(
@@ -176,7 +190,7 @@ struct Benchmark {
     // NOLINTNEXTLINE(bugprone-branch-clone)
     if (strategy == "one_python") {
       manager.debugLimitInterpreters(1);
-    } else if (strategy == "multi_python") {
+    } else if (strategy == "multi_python" || strategy == "batched") {
       manager.debugLimitInterpreters(n_threads_);
     }
   }
@@ -199,6 +213,8 @@ struct Benchmark {
     // NOLINTNEXTLINE(bugprone-branch-clone)
     if (strategy_ == "jit") {
       run_one_work_item = RunJIT(file_to_run_);
+    } else if (strategy_ == "batched") {
+      run_one_work_item = RunBatched(package, n_threads_);
     } else {
       run_one_work_item = RunPython(package, manager_.allInstances().data());
     }
@@ -311,7 +327,13 @@ int main(int argc, char* argv[]) {
       if (n_thread > max_thread) {
         continue;
       }
-      for (std::string strategy : {"one_python", "multi_python", "jit"}) {
+      for (std::string strategy :
+           {"one_python", "multi_python", "batched", "jit"}) {
+        if (strategy == "batched" && cuda) {
+          // the cuda wrapper takes the device index as its first argument,
+          // which cannot be batched
+          continue;
+        }
         if (strategy == "jit") {
           if (!jit_enable) {
             continue;
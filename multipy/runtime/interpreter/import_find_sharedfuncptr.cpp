@@ -68,6 +68,21 @@ extern "C" dl_funcptr _PyImport_FindSharedFuncptr(
   assert(r);
   return r;
 }
+// adds up the load timings of every library loaded by this interpreter.
+__attribute__((visibility("default"))) void deploy_library_load_timings(
+    torch::deploy::LoadTimings* timings) {
+  *timings = torch::deploy::LoadTimings();
+  for (const auto* files : {&search_files_, &loaded_files_}) {
+    for (const auto& f : *files) {
+      const auto& t = f->load_timings();
+      timings->reserve += t.reserve;
+      timings->map_segments += t.map_segments;
+      timings->relocate += t.relocate;
+      timings->initialize += t.initialize;
+      timings->total += t.total;
+    }
+  }
+}
 __attribute__((visibility("default"))) void deploy_flush_python_libs() {
   loaded_files_.clear();
   search_files_.clear();
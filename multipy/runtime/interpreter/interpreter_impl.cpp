@@ -17,17 +17,20 @@
 #include <pybind11/embed.h>
 #include <pybind11/functional.h>
 #include <pybind11/stl.h>
+#include <c10/util/SmallVector.h>
 #include <torch/csrc/Dtype.h>
 #include <torch/csrc/DynamicTypes.h>
 #include <torch/csrc/autograd/generated/variable_factories.h>
 #include <torch/csrc/jit/frontend/tracer.h>
 #include <cassert>
+#include <cstddef>
 #include <cstdio>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <optional>
 #include <thread>
+#include <unordered_map>
 
 namespace py = pybind11;
 using namespace py::literals;
@@ -205,6 +208,7 @@ static py::object global_impl(const char* module, const char* name) {
 }
 
 using at::IValue;
+using torch::deploy::CallResult;
 using torch::deploy::Obj;
 using torch::deploy::PickledObject;
 
@@ -250,6 +254,97 @@ bool file_exists(const std::string& path) {
   return (stat(path.c_str(), &buf) == 0);
 }
 
+// Free list allocator for the `ConcreteInterpreterObj` handles of one
+// interpreter, which are created for every `attr`, `call` and `global`. Blocks
+// are carved from slabs which are only released with the interpreter, so in
+// steady state no handle hits the heap. It is guarded by the GIL, which is held
+// whenever a handle is created or destroyed as it owns a python object. Every
+// handle shares ownership of the pool through its allocator, so the slabs are
+// only released once the interpreter and all of its handles are gone.
+class __attribute__((visibility("hidden"))) ObjPool {
+ public:
+  ObjPool() = default;
+  ObjPool(const ObjPool&) = delete;
+  ObjPool& operator=(const ObjPool&) = delete;
+
+  void* allocate(size_t size) {
+    if (size > kBlockSize) {
+      return ::operator new(size);
+    }
+    if (!free_) {
+      addSlab();
+    }
+    FreeBlock* block = free_;
+    free_ = block->next;
+    return block;
+  }
+
+  void deallocate(void* ptr, size_t size) {
+    if (size > kBlockSize) {
+      ::operator delete(ptr);
+      return;
+    }
+    auto block = static_cast<FreeBlock*>(ptr);
+    block->next = free_;
+    free_ = block;
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+  static constexpr size_t kBlockSize = 128;
+  static constexpr size_t kBlocksPerSlab = 256;
+  static_assert(kBlockSize % alignof(std::max_align_t) == 0);
+
+  void addSlab() {
+    slabs_.emplace_back(new std::max_align_t
+                            [kBlockSize * kBlocksPerSlab /
+                             sizeof(std::max_align_t)]);
+    char* base = reinterpret_cast<char*>(slabs_.back().get());
+    for (size_t i = kBlocksPerSlab; i-- > 0;) {
+      auto block = reinterpret_cast<FreeBlock*>(base + i * kBlockSize);
+      block->next = free_;
+      free_ = block;
+    }
+  }
+
+  FreeBlock* free_ = nullptr;
+  std::vector<std::unique_ptr<std::max_align_t[]>> slabs_;
+};
+
+template <typename T>
+struct __attribute__((visibility("hidden"))) ObjPoolAllocator {
+  using value_type = T;
+  explicit ObjPoolAllocator(std::shared_ptr<ObjPool> pool)
+      : pool_(std::move(pool)) {}
+  template <typename U>
+  ObjPoolAllocator(const ObjPoolAllocator<U>& other) : pool_(other.pool_) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+  }
+  void deallocate(T* ptr, size_t n) {
+    pool_->deallocate(ptr, n * sizeof(T));
+  }
+  template <typename U>
+  bool operator==(const ObjPoolAllocator<U>& other) const {
+    return pool_ == other.pool_;
+  }
+  template <typename U>
+  bool operator!=(const ObjPoolAllocator<U>& other) const {
+    return pool_ != other.pool_;
+  }
+
+  std::shared_ptr<ObjPool> pool_;
+};
+
+// Returns a handle owned by `session` for `obj`, allocated from the pool of
+// the session's interpreter.
+static torch::deploy::Obj makeObj(
+    py::object obj,
+    torch::deploy::InterpreterSessionImpl* session);
+
 struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
     : public torch::deploy::InterpreterObj {
   friend struct torch::deploy::Obj;
@@ -263,7 +358,7 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
       at::IValue value,
       torch::deploy::InterpreterSessionImpl* owningSession)
       : torch::deploy::InterpreterObj(owningSession),
-        pyObject_(multipy::toPyObject(value)) {}
+        pyObject_(toPyObject(value)) {}
   ConcreteInterpreterObj() : pyObject_() {}
   ConcreteInterpreterObj(const ConcreteInterpreterObj& obj) = delete;
   ConcreteInterpreterObj& operator=(const ConcreteInterpreterObj& obj) = delete;
@@ -278,11 +373,28 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
 
   at::IValue toIValue() const override {
     MULTIPY_SAFE_RETHROW {
-      py::handle pyObj = getPyObject();
-      return multipy::toTypeInferredIValue(pyObj);
+      return fromPyObject(getPyObject());
     };
   }
 
+  // Converts `pyObj` to an IValue, tensors skip the converter list.
+  static at::IValue fromPyObject(py::handle pyObj) {
+    if (auto tensor = multipy::unwrapTensor(pyObj)) {
+      return *tensor;
+    }
+    return multipy::toTypeInferredIValue(pyObj);
+  }
+
+  // Converts `value` to python, tensors skip the converter list.
+  static py::object toPyObject(const at::IValue& value) {
+    if (value.isTensor()) {
+      if (auto obj = multipy::wrapTensor(value.toTensor())) {
+        return std::move(*obj);
+      }
+    }
+    return multipy::toPyObject(value);
+  }
+
   py::object call(py::handle args, py::handle kwargs = nullptr) {
     MULTIPY_SAFE_RETHROW {
       PyObject* result =
@@ -300,15 +412,12 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
     MULTIPY_SAFE_RETHROW {
       py::tuple m_args(args.size());
       size_t i = 0;
-      for (std::shared_ptr<torch::deploy::InterpreterObj> iObj : args) {
-        std::shared_ptr<ConcreteInterpreterObj> cObj =
-            std::dynamic_pointer_cast<ConcreteInterpreterObj>(iObj);
-        m_args[i++] = cObj->getPyObject();
+      for (const auto& iObj : args) {
+        m_args[i++] =
+            static_cast<ConcreteInterpreterObj*>(iObj.get())->getPyObject();
       }
       py::object pyObj = call(m_args);
-      std::shared_ptr<ConcreteInterpreterObj> cObj =
-          std::make_shared<ConcreteInterpreterObj>(pyObj, owningSession_);
-      return Obj(cObj);
+      return makeObj(std::move(pyObj), owningSession_);
     };
   }
 
@@ -316,12 +425,10 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
     MULTIPY_SAFE_RETHROW {
       py::tuple m_args(args.size());
       for (size_t i = 0, N = args.size(); i != N; ++i) {
-        m_args[i] = multipy::toPyObject(args[i]);
+        m_args[i] = toPyObject(args[i]);
       }
       py::object pyObj = call(m_args);
-      std::shared_ptr<ConcreteInterpreterObj> cObj =
-          std::make_shared<ConcreteInterpreterObj>(pyObj, owningSession_);
-      return Obj(cObj);
+      return makeObj(std::move(pyObj), owningSession_);
     };
   }
 
@@ -331,18 +438,15 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
     MULTIPY_SAFE_RETHROW {
       py::tuple py_args(args.size());
       for (size_t i = 0, N = args.size(); i != N; ++i) {
-        py_args[i] = multipy::toPyObject(args[i]);
+        py_args[i] = toPyObject(args[i]);
       }
 
       py::dict py_kwargs;
       for (auto kv : kwargs) {
-        py_kwargs[py::cast(std::get<0>(kv))] =
-            multipy::toPyObject(std::get<1>(kv));
+        py_kwargs[py::cast(std::get<0>(kv))] = toPyObject(std::get<1>(kv));
       }
       py::object pyObj = call(py_args, py_kwargs);
-      std::shared_ptr<ConcreteInterpreterObj> cObj =
-          std::make_shared<ConcreteInterpreterObj>(pyObj, owningSession_);
-      return Obj(cObj);
+      return makeObj(std::move(pyObj), owningSession_);
     };
   }
 
@@ -351,6 +455,10 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
     return callKwargs({}, kwargs);
   }
 
+  torch::deploy::Obj call(
+      const torch::deploy::CallSignature& signature,
+      at::ArrayRef<at::IValue> args) override;
+
   bool hasattr(const char* attribute) override {
     MULTIPY_SAFE_RETHROW {
       return py::hasattr(getPyObject(), attribute);
@@ -359,11 +467,8 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterObj
 
   torch::deploy::Obj attr(const char* attribute) override {
     MULTIPY_SAFE_RETHROW {
-      bool a = hasattr(attribute);
       py::object pyObj = getPyObject().attr(attribute);
-      std::shared_ptr<ConcreteInterpreterObj> cObj =
-          std::make_shared<ConcreteInterpreterObj>(pyObj, owningSession_);
-      return Obj(cObj);
+      return makeObj(std::move(pyObj), owningSession_);
     };
   }
 
@@ -465,6 +570,14 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterImpl
     // note: this leads the referneces to these objects, but we are about to
     // deinit python anyway so it doesn't matter
     objects.release();
+    for (auto& entry : keywordNames_) {
+      entry.second.release();
+    }
+    for (auto& methods : boundMethods_) {
+      for (auto& entry : methods.second) {
+        entry.second.release();
+      }
+    }
     saveStorage.release();
     loadStorage.release();
     getPackage.release();
@@ -490,12 +603,75 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterImpl
         .attr("append")(register_module_importer);
   }
 
+  void beforeFork() override {
+    // same lock order as InitLockAcquire: init_lock -> GIL
+    init_lock_.lock();
+    forkGilState_ = PyGILState_Ensure();
+    PyOS_BeforeFork();
+  }
+
+  void afterForkParent() override {
+    PyOS_AfterFork_Parent();
+    PyGILState_Release(forkGilState_);
+    init_lock_.unlock();
+  }
+
+  void afterForkChild() override {
+    // reinitializes the GIL and forgets the threads which do not exist in the
+    // child process.
+    PyOS_AfterFork_Child();
+    PyGILState_Release(forkGilState_);
+    init_lock_.unlock();
+  }
+
+  // Returns the interned keyword names of `signature` as a tuple, or a null
+  // handle if it has none. They are created the first time a signature is
+  // called on this interpreter and cached for at most kMaxKeywordNames
+  // signatures, since nothing tells the interpreter when a signature is no
+  // longer used. Must be called with the GIL held.
+  py::object keywordNames(const torch::deploy::CallSignature& signature) {
+    if (signature.keyword.empty()) {
+      return py::object();
+    }
+    if (signature.id != 0) {
+      auto it = keywordNames_.find(signature.id);
+      if (it != keywordNames_.end()) {
+        return it->second;
+      }
+    }
+    py::tuple names(signature.keyword.size());
+    for (size_t i = 0, N = signature.keyword.size(); i != N; ++i) {
+      PyObject* name =
+          PyUnicode_InternFromString(signature.keyword[i].name.c_str());
+      if (!name) {
+        throw py::error_already_set();
+      }
+      names[i] = py::reinterpret_steal<py::object>(name);
+    }
+    if (signature.id != 0) {
+      if (keywordNames_.size() >= kMaxKeywordNames) {
+        keywordNames_.erase(keywordNames_.begin());
+      }
+      keywordNames_.emplace(signature.id, names);
+    }
+    return std::move(names);
+  }
+
   torch::deploy::InterpreterSessionImpl* acquireSession() override;
   py::object saveStorage;
   py::object loadStorage;
   py::object getPackage;
   py::dict objects;
   std::mutex init_lock_;
+  PyGILState_STATE forkGilState_;
+  std::shared_ptr<ObjPool> objPool_ = std::make_shared<ObjPool>();
+  // keyed by CallSignature::id, guarded by the GIL.
+  static constexpr size_t kMaxKeywordNames = 1024;
+  std::unordered_map<int64_t, py::object> keywordNames_;
+  // bound methods of the objects in `objects` keyed by object id and method
+  // name, guarded by the GIL.
+  std::unordered_map<int64_t, std::unordered_map<std::string, py::object>>
+      boundMethods_;
 };
 
 struct __attribute__((visibility("hidden"))) ConcreteInterpreterSessionImpl
@@ -510,7 +686,7 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterSessionImpl
 
   Obj fromIValue(IValue value) override {
     MULTIPY_SAFE_RETHROW {
-      return wrap(multipy::toPyObject(value));
+      return wrap(ConcreteInterpreterObj::toPyObject(value));
     };
   }
 
@@ -543,8 +719,9 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterSessionImpl
         dtypes_c.push_back(
             reinterpret_cast<THPDtype*>(dtypes[i].ptr())->scalar_type);
       }
+      // the only copy of the pickle bytes, shared from now on.
       return PickledObject{
-          bytes,
+          std::make_shared<const std::string>(bytes),
           std::move(storages_c),
           std::move(dtypes_c),
           std::move(container_file)};
@@ -566,27 +743,67 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterSessionImpl
       if (objects.contains(id_p)) {
         return wrap(objects[id_p]);
       }
+      return wrap(load(id_p, obj));
+    };
+  }
 
-      py::tuple storages(obj.storages_.size());
-      for (size_t i = 0, N = obj.storages_.size(); i < N; ++i) {
-        py::object new_storage = py::reinterpret_steal<py::object>(
-            multipy::createPyObject(obj.storages_[i]));
-        storages[i] = std::move(new_storage);
-      }
-      py::tuple dtypes(obj.types_.size());
-      for (size_t i = 0, N = obj.types_.size(); i < N; ++i) {
-        auto dtype = (PyObject*)multipy::getTHPDtype(obj.types_[i]);
-        Py_INCREF(dtype);
-        dtypes[i] = dtype;
+  Obj unpickle(const PickledObject& obj) override {
+    MULTIPY_SAFE_RETHROW {
+      InitLockAcquire guard(interp_->init_lock_);
+      return wrap(load(py::none(), obj));
+    };
+  }
+
+  // Unpickles `obj`, sharing its storages, and registers it under `id` unless
+  // `id` is None. init_lock_ must be held.
+  py::object load(py::handle id, const PickledObject& obj) {
+    py::tuple storages(obj.storages_.size());
+    for (size_t i = 0, N = obj.storages_.size(); i < N; ++i) {
+      py::object new_storage = py::reinterpret_steal<py::object>(
+          multipy::createPyObject(obj.storages_[i]));
+      storages[i] = std::move(new_storage);
+    }
+    py::tuple dtypes(obj.types_.size());
+    for (size_t i = 0, N = obj.types_.size(); i < N; ++i) {
+      auto dtype = (PyObject*)multipy::getTHPDtype(obj.types_[i]);
+      Py_INCREF(dtype);
+      dtypes[i] = dtype;
+    }
+    // the unpickler reads the shared bytes in place and keeps no view of them
+    // once it returns.
+    auto data = py::reinterpret_steal<py::object>(PyMemoryView_FromMemory(
+        const_cast<char*>(obj.data_->data()),
+        static_cast<Py_ssize_t>(obj.data_->size()),
+        PyBUF_READ));
+    if (!data) {
+      throw py::error_already_set();
+    }
+    return interp_->loadStorage(
+        id, obj.containerFile_, data, storages, dtypes);
+  }
+
+  Obj methodOrGet(int64_t id, const PickledObject& obj, const std::string& name)
+      override {
+    MULTIPY_SAFE_RETHROW {
+      auto& boundMethods = interp_->boundMethods_;
+      auto methods = boundMethods.find(id);
+      if (methods != boundMethods.end()) {
+        auto it = methods->second.find(name);
+        if (it != methods->second.end()) {
+          return wrap(it->second);
+        }
       }
-      py::object result = interp_->loadStorage(
-          id, obj.containerFile_, py::bytes(obj.data_), storages, dtypes);
-      return wrap(result);
+      // unpickleOrGet can release the GIL, so the cache is only updated
+      // afterwards.
+      py::object method = unwrap(unpickleOrGet(id, obj)).attr(name.c_str());
+      boundMethods[id].emplace(name, method);
+      return wrap(std::move(method));
     };
   }
 
   void unload(int64_t id) override {
     MULTIPY_SAFE_RETHROW {
+      interp_->boundMethods_.erase(id);
       py::dict objects = interp_->objects;
       py::object id_p = py::cast(id);
       if (objects.contains(id_p)) {
@@ -639,6 +856,39 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterSessionImpl
     };
   }
 
+  std::vector<CallResult> callMany(
+      at::ArrayRef<std::pair<Obj, at::ArrayRef<at::IValue>>> calls) override {
+    MULTIPY_SAFE_RETHROW {
+      // the GIL is held by this session for all the calls, a failing call
+      // only sets its own error.
+      std::vector<CallResult> results(calls.size());
+      for (size_t i = 0, N = calls.size(); i != N; ++i) {
+        try {
+          const auto& args = calls[i].second;
+          py::tuple pyArgs(args.size());
+          for (size_t j = 0, M = args.size(); j != M; ++j) {
+            pyArgs[j] = ConcreteInterpreterObj::toPyObject(args[j]);
+          }
+          PyObject* result = PyObject_Call(
+              unwrap(calls[i].first).ptr(), pyArgs.ptr(), nullptr);
+          if (!result) {
+            throw py::error_already_set();
+          }
+          results[i].value = ConcreteInterpreterObj::fromPyObject(
+              py::reinterpret_steal<py::object>(result));
+        } catch (py::error_already_set& err) {
+          if (err.matches(PyExc_SystemExit)) {
+            throw;
+          }
+          results[i].error = err.what();
+        } catch (std::exception& err) {
+          results[i].error = err.what();
+        }
+      }
+      return results;
+    };
+  }
+
   static py::object
   call(py::handle object, py::handle args, py::handle kwargs = nullptr) {
     MULTIPY_SAFE_RETHROW {
@@ -654,19 +904,16 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterSessionImpl
     if (isDefault(obj)) {
       return defaultObj_;
     }
-    std::shared_ptr<ConcreteInterpreterObj> cObj =
-        std::dynamic_pointer_cast<ConcreteInterpreterObj>(getBaseObj(obj));
-    py::handle h = cObj->getPyObject();
-    return h;
+    // every handle of this interpreter is a ConcreteInterpreterObj.
+    return static_cast<ConcreteInterpreterObj*>(getBaseObj(obj).get())
+        ->getPyObject();
   }
 
   Obj wrap(py::object obj) {
     if (!defaultObj_) {
       defaultObj_ = obj;
     }
-    std::shared_ptr<torch::deploy::InterpreterObj> pConcreteObj =
-        std::make_shared<ConcreteInterpreterObj>(std::move(obj), this);
-    return Obj(pConcreteObj);
+    return makeObj(std::move(obj), this);
   }
 
   py::handle defaultObj_;
@@ -674,6 +921,63 @@ struct __attribute__((visibility("hidden"))) ConcreteInterpreterSessionImpl
   ScopedAcquire acquire_;
 };
 
+static torch::deploy::Obj makeObj(
+    py::object obj,
+    torch::deploy::InterpreterSessionImpl* session) {
+  const auto& pool =
+      static_cast<ConcreteInterpreterSessionImpl*>(session)->interp_->objPool_;
+  return torch::deploy::Obj(std::allocate_shared<ConcreteInterpreterObj>(
+      ObjPoolAllocator<ConcreteInterpreterObj>(pool), std::move(obj), session));
+}
+
+torch::deploy::Obj ConcreteInterpreterObj::call(
+    const torch::deploy::CallSignature& signature,
+    at::ArrayRef<at::IValue> args) {
+  MULTIPY_SAFE_RETHROW {
+    const size_t nargs = signature.positional.size();
+    MULTIPY_CHECK(
+        args.size() == nargs + signature.keyword.size(),
+        "number of arguments does not match the call signature");
+    auto session = static_cast<ConcreteInterpreterSessionImpl*>(owningSession_);
+    MULTIPY_CHECK(session, "object does not belong to a session");
+    py::object kwnames = session->interp_->keywordNames(signature);
+
+    c10::SmallVector<py::object, 8> values;
+    for (const auto& arg : args) {
+      values.push_back(toPyObject(arg));
+    }
+#if PY_VERSION_HEX >= 0x03090000
+    // the leading slot lets the callee prepend `self` in place when calling a
+    // bound method (PY_VECTORCALL_ARGUMENTS_OFFSET).
+    c10::SmallVector<PyObject*, 9> argv{nullptr};
+    for (const auto& value : values) {
+      argv.push_back(value.ptr());
+    }
+    PyObject* result = PyObject_Vectorcall(
+        getPyObject().ptr(),
+        argv.data() + 1,
+        nargs | PY_VECTORCALL_ARGUMENTS_OFFSET,
+        kwnames.ptr());
+#else
+    py::tuple pyArgs(nargs);
+    for (size_t i = 0; i != nargs; ++i) {
+      pyArgs[i] = values[i];
+    }
+    py::dict pyKwargs;
+    for (size_t i = nargs, N = values.size(); i != N; ++i) {
+      pyKwargs[py::handle(PyTuple_GET_ITEM(kwnames.ptr(), i - nargs))] =
+          values[i];
+    }
+    PyObject* result =
+        PyObject_Call(getPyObject().ptr(), pyArgs.ptr(), pyKwargs.ptr());
+#endif
+    if (!result) {
+      throw py::error_already_set();
+    }
+    return makeObj(py::reinterpret_steal<py::object>(result), owningSession_);
+  };
+}
+
 torch::deploy::InterpreterSessionImpl*
 ConcreteInterpreterImpl::acquireSession() {
   return new ConcreteInterpreterSessionImpl(this);
@@ -22,7 +22,8 @@ struct Obj;
 
 // Representation a Pickled Object
 struct PickledObject {
-  std::string data_;
+  // the pickle bytes, immutable and shared by all copies of the object.
+  std::shared_ptr<const std::string> data_;
   std::vector<at::Storage> storages_;
   // types for the storages, required to
   // reconstruct correct Python storages
@@ -30,6 +31,65 @@ struct PickledObject {
   std::shared_ptr<caffe2::serialize::PyTorchStreamReader> containerFile_;
 };
 
+// The kind of value an argument of a `CallSignature` accepts.
+enum class ArgKind {
+  Any,
+  Tensor,
+  Int,
+  Double,
+  Bool,
+  String,
+  List,
+  Tuple,
+};
+
+inline bool matchesKind(const at::IValue& value, ArgKind kind) {
+  switch (kind) {
+    case ArgKind::Any:
+      return true;
+    case ArgKind::Tensor:
+      return value.isTensor();
+    case ArgKind::Int:
+      return value.isInt();
+    case ArgKind::Double:
+      return value.isDouble();
+    case ArgKind::Bool:
+      return value.isBool();
+    case ArgKind::String:
+      return value.isString();
+    case ArgKind::List:
+      return value.isList();
+    case ArgKind::Tuple:
+      return value.isTuple();
+  }
+  return false;
+}
+
+struct CallArgument {
+  std::string name;
+  ArgKind kind = ArgKind::Any;
+};
+
+// Declared signature of a call: its values are the `positional` arguments
+// followed by the `keyword` arguments, in order. A non zero `id` identifies
+// the signature to the interpreters, which then intern its keyword names once
+// instead of on every call; it is assigned by `ReplicatedObj::bind`.
+struct CallSignature {
+  std::vector<CallArgument> positional;
+  std::vector<CallArgument> keyword;
+  int64_t id = 0;
+};
+
+// Outcome of one call made by `InterpreterSession::callMany`: the value it
+// returned or, if it failed, the message of its exception.
+struct CallResult {
+  at::IValue value;
+  std::optional<std::string> error;
+  bool ok() const {
+    return !error.has_value();
+  }
+};
+
 // PickledObject contains a python object that's been pickled with the tensors
 // saved separately. Unpickling this will share the underlying data across
 // multiple copies/interpreters.
@@ -60,6 +120,9 @@ struct InterpreterObj {
       std::unordered_map<std::string, c10::IValue> kwargs) = 0;
   virtual Obj callKwargs(
       std::unordered_map<std::string, c10::IValue> kwargs) = 0;
+  virtual Obj call(
+      const CallSignature& signature,
+      at::ArrayRef<at::IValue> args) = 0;
   virtual bool hasattr(const char* attr) = 0;
   virtual Obj attr(const char* attr) = 0;
 };
@@ -97,6 +160,10 @@ struct Obj {
   /// Call an `Obj` callable, with named arguments given by the dictionary
   /// kwargs. Equivalent to `__call__` in python.
   Obj callKwargs(std::unordered_map<std::string, c10::IValue> kwargs);
+  /// Call an `Obj` callable with `args`, the values of the positional
+  /// arguments of `signature` followed by those of its keyword arguments.
+  /// Unlike `callKwargs` no kwargs dictionary is built.
+  Obj call(const CallSignature& signature, at::ArrayRef<at::IValue> args);
   /// Returns true if `Obj` has attribute with name `attr` and false otherwise.
   bool hasattr(const char* attr);
   /// Returns attribute `attr` from `Obj`. This is equivalent to calling
@@ -114,6 +181,7 @@ struct InterpreterSessionImpl {
   friend struct ReplicatedObj;
   friend struct Obj;
   friend struct InterpreterSession;
+  friend struct InterpreterManager;
   friend struct ReplicatedObjImpl;
 
   virtual ~InterpreterSessionImpl() = default;
@@ -126,6 +194,14 @@ struct InterpreterSessionImpl {
           containerFile_) = 0;
   virtual PickledObject pickle(Obj container, Obj obj) = 0;
   virtual Obj unpickleOrGet(int64_t id, const PickledObject& obj) = 0;
+  // unpickles `obj` without registering it as a replicated object.
+  virtual Obj unpickle(const PickledObject& obj) = 0;
+  // bound method `name` of the object unpickled as `id`, looked up once and
+  // kept until `unload(id)`.
+  virtual Obj methodOrGet(
+      int64_t id,
+      const PickledObject& obj,
+      const std::string& name) = 0;
   virtual void unload(int64_t id) = 0;
 
   virtual at::IValue toIValue(Obj obj) const = 0;
@@ -141,6 +217,8 @@ struct InterpreterSessionImpl {
       std::unordered_map<std::string, c10::IValue> kwargs) = 0;
   virtual Obj attr(Obj obj, const char* attr) = 0;
   virtual bool hasattr(Obj obj, const char* attr) = 0;
+  virtual std::vector<CallResult> callMany(
+      at::ArrayRef<std::pair<Obj, at::ArrayRef<at::IValue>>> calls) = 0;
 
  protected:
   int64_t isDefault(Obj obj) const {
@@ -160,6 +238,13 @@ struct InterpreterImpl {
   virtual void setFindModule(
       std::function<std::optional<std::string>(const std::string&)>
           find_module) = 0;
+  // Called by the forking thread around fork(). beforeFork waits until no
+  // other thread is running python on this interpreter and keeps it that way
+  // until afterForkParent or afterForkChild is called in the respective
+  // process.
+  virtual void beforeFork() {}
+  virtual void afterForkParent() {}
+  virtual void afterForkChild() {}
   virtual ~InterpreterImpl() = default; // this will uninitialize python
 };
 
@@ -191,6 +276,11 @@ inline Obj Obj::callKwargs(
     std::unordered_map<std::string, c10::IValue> kwargs) {
   return baseObj_->callKwargs(std::move(kwargs));
 }
+inline Obj Obj::call(
+    const CallSignature& signature,
+    at::ArrayRef<at::IValue> args) {
+  return baseObj_->call(signature, args);
+}
 inline bool Obj::hasattr(const char* attr) {
   return baseObj_->hasattr(attr);
 }
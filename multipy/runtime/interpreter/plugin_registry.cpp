@@ -9,8 +9,17 @@ std::vector<Converter*>& getConverters() {
   return converters;
 }
 
+// The first registered converter which handles tensors, if any.
+Converter*& getTensorConverter() {
+  static Converter* tensorConverter = nullptr;
+  return tensorConverter;
+}
+
 void registerConverter(Converter* c) {
   getConverters().emplace_back(c);
+  if (!getTensorConverter() && c->handlesTensors()) {
+    getTensorConverter() = c;
+  }
 }
 
 void deregisterConverter(Converter* c) {
@@ -19,6 +28,15 @@ void deregisterConverter(Converter* c) {
   if (it != converters.end()) {
     converters.erase(it);
   }
+  if (getTensorConverter() == c) {
+    getTensorConverter() = nullptr;
+    for (auto other : converters) {
+      if (other->handlesTensors()) {
+        getTensorConverter() = other;
+        break;
+      }
+    }
+  }
 }
 
 at::IValue toTypeInferredIValue(py::handle input) {
@@ -57,6 +75,21 @@ PyObject* createPyObject(const at::Storage& storage) {
   }
   throw std::runtime_error("failed to createPyObject");
 }
+std::optional<py::object> wrapTensor(const at::Tensor& tensor) {
+  Converter* c = getTensorConverter();
+  if (!c || !tensor.defined() ||
+      tensor.unsafeGetTensorImpl()->is_wrapped_number()) {
+    return std::nullopt;
+  }
+  return c->wrapTensor(tensor);
+}
+std::optional<at::Tensor> unwrapTensor(py::handle input) {
+  Converter* c = getTensorConverter();
+  if (!c) {
+    return std::nullopt;
+  }
+  return c->unwrapTensor(input);
+}
 THPDtype* getTHPDtype(at::ScalarType scalarType) {
   for (auto c : getConverters()) {
     auto out = c->getTHPDtype(scalarType);
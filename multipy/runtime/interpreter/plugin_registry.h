@@ -33,6 +33,22 @@ class Converter {
 
   // Returns the `THPDtype` of `scalarType`
   virtual std::optional<THPDtype*> getTHPDtype(at::ScalarType scalarType) = 0;
+
+  /// Returns true if this converter implements `wrapTensor` and
+  /// `unwrapTensor`, the fast paths used for tensor arguments and results.
+  virtual bool handlesTensors() const {
+    return false;
+  }
+
+  /// Wraps a defined `tensor` as a python tensor sharing its storage.
+  virtual std::optional<py::object> wrapTensor(const at::Tensor& /*tensor*/) {
+    return std::nullopt;
+  }
+
+  /// Returns the tensor held by `input` if it is a python tensor.
+  virtual std::optional<at::Tensor> unwrapTensor(py::handle /*input*/) {
+    return std::nullopt;
+  }
 };
 
 /// Registers a converter to be used by torch::deploy / multipy.
@@ -49,4 +65,12 @@ py::object toPyObject(at::IValue ivalue);
 at::Storage createStorage(PyObject* obj);
 PyObject* createPyObject(const at::Storage& storage);
 THPDtype* getTHPDtype(at::ScalarType scalarType);
+
+/// Fast paths for tensors, which skip the converter list and type inference
+/// by going straight to the first converter that handles tensors. They return
+/// std::nullopt when the general path has to be used instead: no converter
+/// handles tensors, `input` is not a tensor, or `tensor` is undefined or a
+/// wrapped number (which python sees as a scalar).
+std::optional<py::object> wrapTensor(const at::Tensor& tensor);
+std::optional<at::Tensor> unwrapTensor(py::handle input);
 } // namespace multipy
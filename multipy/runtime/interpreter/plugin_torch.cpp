@@ -1,3 +1,4 @@
+#include <torch/csrc/autograd/python_variable.h>
 #include <torch/csrc/jit/python/pybind_utils.h>
 #include <torch/csrc/lazy/core/debug_util.h>
 #include <optional>
@@ -34,6 +35,22 @@ class TorchConverter : public Converter {
   std::optional<THPDtype*> getTHPDtype(at::ScalarType scalarType) override {
     return ::torch::getTHPDtype(scalarType);
   }
+  bool handlesTensors() const override {
+    return true;
+  }
+  std::optional<py::object> wrapTensor(const at::Tensor& tensor) override {
+    PyObject* obj = THPVariable_Wrap(tensor);
+    if (!obj) {
+      throw py::error_already_set();
+    }
+    return py::reinterpret_steal<py::object>(obj);
+  }
+  std::optional<at::Tensor> unwrapTensor(py::handle input) override {
+    if (!THPVariable_Check(input.ptr())) {
+      return std::nullopt;
+    }
+    return THPVariable_Unpack(input.ptr());
+  }
 };
 
 TorchConverter converter;
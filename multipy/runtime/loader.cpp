@@ -45,17 +45,30 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef __x86_64__
+#include <cpuid.h>
+#endif
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cinttypes>
 #include <climits>
 #include <cstdint>
 #include <cstring>
 #include <functional>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 // Get PAGE_SIZE and PAGE_MASK.
 #include <sys/user.h>
@@ -237,10 +250,388 @@ struct GnuHash {
     hash = h;
     name_len = reinterpret_cast<const char*>(name_bytes) - name;
   }
+  GnuHash(uint32_t hash, uint32_t name_len) : hash(hash), name_len(name_len) {}
   uint32_t hash;
   uint32_t name_len;
 };
 
+// Process-wide cache of symbol lookups in libraries opened with dlopen.
+// Every library we load resolves its relocations against the same system
+// libraries (libc, libstdc++, libtorch, ...), and every interpreter loads the
+// same extension modules, so the same dlsym calls would otherwise be repeated
+// for each library in each interpreter. Entries are keyed by the dlopen
+// handle, the symbol name and its version, and are dropped when the
+// SystemLibrary wrapping the handle is destroyed.
+class SymbolCache {
+ public:
+  enum Result : int { MISS = 0, FOUND = 1, NOT_FOUND = 2 };
+
+  Result find(
+      void* handle,
+      std::string_view name,
+      std::string_view version,
+      uint32_t hash,
+      Elf64_Addr* addr) const {
+    const Shard& shard = shards_[hash % kShards];
+    std::shared_lock<std::shared_mutex> guard(shard.mutex);
+    auto table = shard.tables.find(handle);
+    if (table == shard.tables.end()) {
+      return MISS;
+    }
+    auto it = table->second.entries.find(Key{name, version, hash});
+    if (it == table->second.entries.end()) {
+      return MISS;
+    }
+    if (!it->second) {
+      return NOT_FOUND;
+    }
+    *addr = *it->second;
+    return FOUND;
+  }
+
+  void insert(
+      void* handle,
+      std::string_view name,
+      std::string_view version,
+      uint32_t hash,
+      std::optional<Elf64_Addr> addr) {
+    Shard& shard = shards_[hash % kShards];
+    std::unique_lock<std::shared_mutex> guard(shard.mutex);
+    auto& table = shard.tables[handle];
+    if (table.entries.count(Key{name, version, hash})) {
+      return;
+    }
+    // keys point into strings owned by the table, which never move since
+    // the deque is only appended to.
+    const std::string& owned_name = table.strings.emplace_back(name);
+    const std::string& owned_version = table.strings.emplace_back(version);
+    table.entries.emplace(Key{owned_name, owned_version, hash}, addr);
+  }
+
+  void invalidate(void* handle) {
+    for (auto& shard : shards_) {
+      std::unique_lock<std::shared_mutex> guard(shard.mutex);
+      shard.tables.erase(handle);
+    }
+  }
+
+  void lock_for_fork() {
+    for (auto& shard : shards_) {
+      shard.mutex.lock();
+    }
+  }
+
+  // a shared_mutex write-locked by the parent cannot be unlocked by the only
+  // thread of the child, which has another id, so the child starts over with
+  // fresh ones.
+  void unlock_after_fork(bool child) {
+    for (auto& shard : shards_) {
+      if (child) {
+        new (&shard.mutex) std::shared_mutex();
+      } else {
+        shard.mutex.unlock();
+      }
+    }
+  }
+
+ private:
+  struct Key {
+    std::string_view name;
+    std::string_view version;
+    uint32_t hash;
+    bool operator==(const Key& rhs) const {
+      return hash == rhs.hash && name == rhs.name && version == rhs.version;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return key.hash; // the GNU hash of the name was already computed
+    }
+  };
+  struct Table {
+    std::unordered_map<Key, std::optional<Elf64_Addr>, KeyHash> entries;
+    std::deque<std::string> strings;
+  };
+
+  // relocations are applied on several threads, so entries are spread over
+  // shards by hash to keep them from contending on a single lock.
+  static constexpr size_t kShards = 16;
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<void*, Table> tables;
+  };
+  std::array<Shard, kShards> shards_;
+};
+
+// Registry of relocated pages that are read-only once a library is loaded,
+// used with LoaderOptions::share_pages. Pages are kept in a memfd and
+// found by content, so every load whose relocations produce the same bytes
+// for a page, e.g. a GOT whose entries all point into libraries shared by
+// the interpreters, maps the single copy in the memfd instead of keeping a
+// private one. Pages are never removed since the mappings of unloaded
+// libraries are kept alive.
+class SharedPageRegistry {
+ public:
+  // Sets fd and offset to the location of a page with the same hash as
+  // `page`, adding a copy of `page` if there is none. Returns 1 if the page
+  // already existed, 0 if it was added and -1 on failure. The caller has to
+  // compare the contents since different pages can have the same hash.
+  int find_or_add(
+      const void* page,
+      size_t size,
+      uint64_t hash,
+      int* fd,
+      uint64_t* offset) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = offsets_.find(hash);
+    if (it != offsets_.end()) {
+      *fd = fd_;
+      *offset = it->second;
+      return 1;
+    }
+    if (fd_ == -1) {
+      // Without memfd support pages are simply not shared; remember that so
+      // later loads do not retry for every page.
+      if (unavailable_) {
+        return -1;
+      }
+      fd_ = memfdCreate("multipy_shared_pages");
+      if (fd_ == -1) {
+        unavailable_ = true;
+        return -1;
+      }
+    }
+    if (pwrite(fd_, page, size, size_) != (ssize_t)size) {
+      return -1;
+    }
+    offsets_.emplace(hash, size_);
+    *fd = fd_;
+    *offset = size_;
+    size_ += size;
+    return 0;
+  }
+
+  void add_saved(size_t bytes) {
+    bytes_saved_ += bytes;
+  }
+
+  size_t saved() const {
+    return bytes_saved_;
+  }
+
+  void lock_for_fork() {
+    mutex_.lock();
+  }
+
+  void unlock_after_fork() {
+    mutex_.unlock();
+  }
+
+ private:
+  std::mutex mutex_;
+  int fd_ = -1;
+  bool unavailable_ = false;
+  uint64_t size_ = 0;
+  std::unordered_map<uint64_t, uint64_t> offsets_;
+  std::atomic<size_t> bytes_saved_{0};
+};
+
+// Relocation snapshots recorded with LoaderOptions::relocation_snapshots, by
+// key. Snapshots are never removed, so the data returned by find stays valid.
+class RelocationSnapshots {
+ public:
+  bool find(const char* key, const char** data, size_t* size) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = snapshots_.find(key);
+    if (it == snapshots_.end()) {
+      return false;
+    }
+    *data = it->second.data();
+    *size = it->second.size();
+    return true;
+  }
+
+  void add(const char* key, const char* data, size_t size) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    snapshots_.emplace(key, std::string(data, size));
+  }
+
+  void lock_for_fork() {
+    mutex_.lock();
+  }
+
+  void unlock_after_fork() {
+    mutex_.unlock();
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::string> snapshots_;
+};
+
+// loader.cpp is linked both into the host and into every copy of the
+// interpreter library, so each copy has its own SymbolCache,
+// SharedPageRegistry and RelocationSnapshots. The copies are opened with
+// RTLD_DEEPBIND, so looking up the host's definitions by name from a copy
+// finds the copy's own ones. Instead the host hands its state to every copy
+// with deploy_set_loader_shared_state once it is opened, see
+// Interpreter::Interpreter. The state is a table of plain C functions so that
+// copies do not need to agree on the layout of C++ types.
+struct LoaderSharedState {
+  int (*symbol_cache_find)(
+      void* handle,
+      const char* name,
+      const char* version,
+      uint32_t hash,
+      Elf64_Addr* addr);
+  void (*symbol_cache_insert)(
+      void* handle,
+      const char* name,
+      const char* version,
+      uint32_t hash,
+      int found,
+      Elf64_Addr addr);
+  void (*symbol_cache_invalidate)(void* handle);
+  int (*shared_pages_find_or_add)(
+      const void* page,
+      size_t size,
+      uint64_t hash,
+      int* fd,
+      uint64_t* offset);
+  void (*shared_pages_add_saved)(size_t bytes);
+  size_t (*shared_pages_saved)();
+  int (*relocation_snapshot_find)(
+      const char* key,
+      const char** data,
+      size_t* size);
+  void (*relocation_snapshot_add)(
+      const char* key,
+      const char* data,
+      size_t size);
+  void (*get_default_options)(LoaderOptions* options);
+  void (*set_default_options)(const LoaderOptions* options);
+  void (*lock_for_fork)();
+  void (*unlock_after_fork)(bool child);
+};
+
+static LoaderOptions env_loader_options() {
+  auto enabled = [](const char* name) {
+    const char* env = getenv(name);
+    return env && std::string(env) == "1";
+  };
+  LoaderOptions options;
+  options.lazy_binding = enabled("MULTIPY_LAZY_BINDING");
+  if (const char* env = getenv("MULTIPY_LOADER_THREADS")) {
+    options.relocation_threads = std::max<size_t>(1, strtoul(env, nullptr, 10));
+  }
+  options.share_pages = enabled("MULTIPY_SHARE_LIBRARY_PAGES");
+  options.relocation_snapshots = enabled("MULTIPY_RELOCATION_SNAPSHOTS");
+  options.print_timings = enabled("MULTIPY_LOADER_TIMINGS");
+  return options;
+}
+
+static const LoaderSharedState& local_loader_state() {
+  static SymbolCache symbol_cache;
+  static SharedPageRegistry shared_pages;
+  static RelocationSnapshots relocation_snapshots;
+  static std::mutex default_options_mutex;
+  static LoaderOptions default_options = env_loader_options();
+  static const LoaderSharedState state = {
+      [](void* handle,
+         const char* name,
+         const char* version,
+         uint32_t hash,
+         Elf64_Addr* addr) -> int {
+        return symbol_cache.find(
+            handle, name, version ? version : "", hash, addr);
+      },
+      [](void* handle,
+         const char* name,
+         const char* version,
+         uint32_t hash,
+         int found,
+         Elf64_Addr addr) {
+        symbol_cache.insert(
+            handle,
+            name,
+            version ? version : "",
+            hash,
+            found ? std::optional<Elf64_Addr>(addr) : std::nullopt);
+      },
+      [](void* handle) { symbol_cache.invalidate(handle); },
+      [](const void* page,
+         size_t size,
+         uint64_t hash,
+         int* fd,
+         uint64_t* offset) {
+        return shared_pages.find_or_add(page, size, hash, fd, offset);
+      },
+      [](size_t bytes) { shared_pages.add_saved(bytes); },
+      []() { return shared_pages.saved(); },
+      [](const char* key, const char** data, size_t* size) -> int {
+        return relocation_snapshots.find(key, data, size);
+      },
+      [](const char* key, const char* data, size_t size) {
+        relocation_snapshots.add(key, data, size);
+      },
+      [](LoaderOptions* options) {
+        std::lock_guard<std::mutex> guard(default_options_mutex);
+        *options = default_options;
+      },
+      [](const LoaderOptions* options) {
+        std::lock_guard<std::mutex> guard(default_options_mutex);
+        default_options = *options;
+      },
+      []() {
+        symbol_cache.lock_for_fork();
+        shared_pages.lock_for_fork();
+        relocation_snapshots.lock_for_fork();
+        default_options_mutex.lock();
+      },
+      [](bool child) {
+        default_options_mutex.unlock();
+        relocation_snapshots.unlock_after_fork();
+        shared_pages.unlock_after_fork();
+        symbol_cache.unlock_after_fork(child);
+      },
+  };
+  return state;
+}
+
+static std::atomic<const LoaderSharedState*>& host_loader_state() {
+  static std::atomic<const LoaderSharedState*> state{nullptr};
+  return state;
+}
+
+const LoaderSharedState* loader_shared_state() {
+  const LoaderSharedState* host =
+      host_loader_state().load(std::memory_order_acquire);
+  return host ? host : &local_loader_state();
+}
+
+extern "C" __attribute__((visibility("default"))) void
+deploy_set_loader_shared_state(const LoaderSharedState* state) {
+  host_loader_state().store(state, std::memory_order_release);
+}
+
+LoaderOptions LoaderOptions::defaults() {
+  LoaderOptions options;
+  loader_shared_state()->get_default_options(&options);
+  return options;
+}
+
+void LoaderOptions::set_defaults(const LoaderOptions& options) {
+  loader_shared_state()->set_default_options(&options);
+}
+
+void loader_lock_for_fork() {
+  loader_shared_state()->lock_for_fork();
+}
+
+void loader_unlock_after_fork(bool child) {
+  loader_shared_state()->unlock_after_fork(child);
+}
+
 // this is a special builtin in the libc++ API used for telling C++ execption
 // frame unwinding about functions loaded from a pathway other than the libc
 // loader. it is passed a pointer to where the EH_FRAME section was loaded,
@@ -306,6 +697,9 @@ extern "C" {
 DeployModuleInfo __deploy_module_info;
 }
 
+// NOLINTNEXTLINE
+extern "C" void* __dso_handle;
+
 // RAII wrapper around dlopen
 struct __attribute__((visibility("hidden"))) SystemLibraryImpl
     : public SystemLibrary {
@@ -314,7 +708,31 @@ struct __attribute__((visibility("hidden"))) SystemLibraryImpl
 
   std::optional<Elf64_Addr> sym(const char* name, const char* version = nullptr)
       const override {
+    GnuHash hash(name);
+    return hashed_sym(name, version, hash.hash, hash.name_len);
+  }
+
+  std::optional<Elf64_Addr> hashed_sym(
+      const char* name,
+      const char* version,
+      uint32_t gnu_hash,
+      uint32_t name_len) const override {
+    const LoaderSharedState* state = loader_shared_state();
+    Elf64_Addr addr = 0;
+    switch (state->symbol_cache_find(
+        cache_key(), name, version, gnu_hash, &addr)) {
+      case SymbolCache::FOUND:
+        return addr;
+      case SymbolCache::NOT_FOUND:
+        return std::nullopt;
+    }
     void* r = version ? dlvsym(handle_, name, version) : dlsym(handle_, name);
+    // libraries opened later with RTLD_GLOBAL can add definitions to the
+    // global scope, so a missing symbol is only remembered for real handles.
+    if (r || handle_ != RTLD_DEFAULT) {
+      state->symbol_cache_insert(
+          cache_key(), name, version, gnu_hash, r != nullptr, (Elf64_Addr)r);
+    }
     if (!r) {
       return std::nullopt;
     }
@@ -323,13 +741,27 @@ struct __attribute__((visibility("hidden"))) SystemLibraryImpl
 
   std::optional<TLSIndex> tls_sym(const char* name) const override;
 
+  void* handle() const {
+    return handle_;
+  }
+
   ~SystemLibraryImpl() override {
+    // a handle can be reused by a later dlopen once it is closed, whether we
+    // close it or its owner does after dropping this wrapper.
+    loader_shared_state()->symbol_cache_invalidate(cache_key());
     if (own_handle_) {
       dlclose(handle_);
     }
   }
 
  private:
+  // dlsym with RTLD_DEFAULT searches the scope of the calling library, which
+  // differs between copies of this file because the interpreter is opened
+  // with RTLD_DEEPBIND, so those lookups are cached per copy.
+  void* cache_key() const {
+    return handle_ == RTLD_DEFAULT ? &__dso_handle : handle_;
+  }
+
   void* handle_;
   bool own_handle_;
 };
@@ -417,6 +849,8 @@ struct ElfDynamicInfo {
   size_t n_plt_rela_ = 0;
   Elf64_Rela* rela_ = nullptr;
   size_t n_rela_ = 0;
+  Elf64_Addr* plt_got_ = nullptr;
+  bool bind_now_ = false;
   Elf64_Versym* versym_ = nullptr;
   Elf64_Verneed* verneed_ = nullptr;
   size_t n_verneed_ = 0;
@@ -477,6 +911,18 @@ struct ElfDynamicInfo {
         case DT_RELASZ:
           n_rela_ = value / sizeof(Elf64_Rela);
           break;
+        case DT_PLTGOT:
+          plt_got_ = (Elf64_Addr*)addr;
+          break;
+        case DT_BIND_NOW:
+          bind_now_ = true;
+          break;
+        case DT_FLAGS:
+          bind_now_ |= (value & DF_BIND_NOW) != 0;
+          break;
+        case DT_FLAGS_1:
+          bind_now_ |= (value & DF_1_NOW) != 0;
+          break;
 
         case DT_VERSYM:
           versym_ = (Elf64_Versym*)addr;
@@ -797,18 +1243,283 @@ void resolve_needed_libraries(
       search_path.begin() + search_path_start_size, search_path.end());
 }
 
+// Lazy binding of PLT entries, the equivalent of RTLD_LAZY, enabled with
+// LoaderOptions::lazy_binding. R_X86_64_JUMP_SLOT entries are left pointing at
+// their PLT stubs, which push the index of the relocation and jump to
+// PLT0. PLT0 pushes GOT[1] and jumps to GOT[2], which we set to the library
+// and to deploy_lazy_bind_trampoline respectively. The trampoline saves the
+// argument registers, resolves and patches the GOT entry through
+// deploy_lazy_bind_resolve, and tail calls the resolved function, so later
+// calls go to it directly.
+#ifdef __x86_64__
+extern "C" {
+// size of the XSAVE area for the state components enabled by the OS.
 // NOLINTNEXTLINE
-extern "C" void* __dso_handle;
+__attribute__((visibility("hidden"))) uint64_t deploy_lazy_bind_xsave_size =
+    0;
+__attribute__((visibility("hidden"))) void deploy_lazy_bind_trampoline();
+}
+
+// On entry the stack holds GOT[1], the relocation index and the return
+// address of the caller. Vector registers are saved with XSAVE since the
+// resolver may clobber them, including the upper halves of AVX registers.
+asm(R"(
+  .text
+  .p2align 4
+  .globl deploy_lazy_bind_trampoline
+  .hidden deploy_lazy_bind_trampoline
+  .type deploy_lazy_bind_trampoline, @function
+deploy_lazy_bind_trampoline:
+  push %rbp
+  mov %rsp, %rbp
+  push %rax
+  push %rcx
+  push %rdx
+  push %rsi
+  push %rdi
+  push %r8
+  push %r9
+  push %r10
+  sub deploy_lazy_bind_xsave_size(%rip), %rsp
+  and $-64, %rsp
+  movq $0, 512(%rsp)
+  movq $0, 520(%rsp)
+  movq $0, 528(%rsp)
+  movq $0, 536(%rsp)
+  movq $0, 544(%rsp)
+  movq $0, 552(%rsp)
+  movq $0, 560(%rsp)
+  movq $0, 568(%rsp)
+  mov $-1, %eax
+  mov $-1, %edx
+  xsave (%rsp)
+  mov 8(%rbp), %rdi
+  mov 16(%rbp), %rsi
+  call deploy_lazy_bind_resolve
+  mov %rax, %r11
+  mov $-1, %eax
+  mov $-1, %edx
+  xrstor (%rsp)
+  lea -64(%rbp), %rsp
+  pop %r10
+  pop %r9
+  pop %r8
+  pop %rdi
+  pop %rsi
+  pop %rdx
+  pop %rcx
+  pop %rax
+  pop %rbp
+  add $16, %rsp
+  jmp *%r11
+  .size deploy_lazy_bind_trampoline, .-deploy_lazy_bind_trampoline
+)");
+#endif
+
+// whether LoaderOptions::lazy_binding can be honoured on this machine.
+bool lazy_binding_supported() {
+#ifdef __x86_64__
+  static const bool supported = [] {
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    // the trampoline needs XSAVE enabled by the OS (CPUID.1:ECX.OSXSAVE)
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & (1u << 27))) {
+      return false;
+    }
+    __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+    // EBX is the XSAVE area size for the components enabled in XCR0, plus
+    // slack for aligning the area to 64 bytes.
+    deploy_lazy_bind_xsave_size = ebx + 64;
+    return true;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+// Number of threads that apply relocations of a library when
+// LoaderOptions::relocation_threads is 0. Relocation targets are disjoint, so
+// chunks of a table can be applied in any order.
+size_t default_relocation_threads() {
+  static const size_t n_threads = std::max<size_t>(
+      1, std::min<size_t>(std::thread::hardware_concurrency(), 8));
+  return n_threads;
+}
+
+std::chrono::microseconds elapsed_since(
+    std::chrono::steady_clock::time_point& since) {
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - since);
+  since = now;
+  return elapsed;
+}
+
+// Relocation snapshots, enabled with LoaderOptions::relocation_snapshots. The
+// first load of a library records the value each relocation was computed
+// from as an offset from a base: the load bias of the library, its TLS
+// module id, or the load bias of the object loaded by the system loader
+// that defines the symbol. Later loads of the same library in the same
+// symbol environment apply the relocations from those offsets without
+// looking up any symbol. Snapshots only live in this process.
+
+// hex string of the NT_GNU_BUILD_ID note, empty if there is none.
+// `segment` returns where the contents of a PT_NOTE header are mapped.
+std::string read_build_id(
+    const Elf64_Phdr* phdrs,
+    size_t n_phdrs,
+    const std::function<const char*(const Elf64_Phdr&)>& segment) {
+  for (const auto i : c10::irange(n_phdrs)) {
+    const Elf64_Phdr& phdr = phdrs[i];
+    if (phdr.p_type != PT_NOTE) {
+      continue;
+    }
+    const size_t align = phdr.p_align == 8 ? 8 : 4;
+    auto aligned = [&](size_t n) { return (n + align - 1) & ~(align - 1); };
+    const char* cur = segment(phdr);
+    const char* end = cur + phdr.p_filesz;
+    while (cur + sizeof(Elf64_Nhdr) <= end) {
+      auto note = reinterpret_cast<const Elf64_Nhdr*>(cur);
+      const char* name = cur + sizeof(Elf64_Nhdr);
+      const char* desc = name + aligned(note->n_namesz);
+      if (desc + note->n_descsz > end) {
+        break;
+      }
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+          memcmp(name, "GNU", 4) == 0) {
+        std::string result;
+        for (const auto j : c10::irange(note->n_descsz)) {
+          result += fmt::format("{:02x}", (uint8_t)desc[j]);
+        }
+        return result;
+      }
+      cur = desc + aligned(note->n_descsz);
+    }
+  }
+  return "";
+}
+
+// an object loaded by the system loader, identified by its build-id, or by
+// its name if it has none.
+struct LoadedObject {
+  std::string identity;
+  Elf64_Addr base;
+};
+
+// the objects currently loaded by the system loader, the main program first.
+class LoadedObjects {
+ public:
+  LoadedObjects() {
+    std::function<int(struct dl_phdr_info*, size_t)> cb =
+        [&](struct dl_phdr_info* info, size_t size) {
+          std::string build_id = read_build_id(
+              info->dlpi_phdr, info->dlpi_phnum, [&](const Elf64_Phdr& phdr) {
+                return (const char*)(info->dlpi_addr + phdr.p_vaddr);
+              });
+          const char* name = info->dlpi_name ? info->dlpi_name : "";
+          objects_.push_back(LoadedObject{
+              build_id.empty() ? fmt::format("name:{}", name) : build_id,
+              info->dlpi_addr});
+          for (const auto i : c10::irange(info->dlpi_phnum)) {
+            const Elf64_Phdr& phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD) {
+              Elf64_Addr start = info->dlpi_addr + phdr.p_vaddr;
+              ranges_.push_back(
+                  Range{start, start + phdr.p_memsz, objects_.size() - 1});
+            }
+          }
+          return 0;
+        };
+    dl_iterate_phdr(iterate_cb, (void*)&cb);
+    std::sort(
+        ranges_.begin(), ranges_.end(), [](const Range& a, const Range& b) {
+          return a.start < b.start;
+        });
+  }
+
+  const std::vector<LoadedObject>& all() const {
+    return objects_;
+  }
+
+  // object with a segment containing `addr`, nullptr if there is none.
+  const LoadedObject* containing(Elf64_Addr addr) const {
+    auto it = std::upper_bound(
+        ranges_.begin(), ranges_.end(), addr, [](Elf64_Addr a, const Range& r) {
+          return a < r.start;
+        });
+    if (it == ranges_.begin() || addr >= (--it)->end) {
+      return nullptr;
+    }
+    return &objects_[it->object];
+  }
+
+ private:
+  struct Range {
+    Elf64_Addr start;
+    Elf64_Addr end;
+    size_t object;
+  };
+  std::vector<LoadedObject> objects_;
+  std::vector<Range> ranges_;
+};
+
+// bases the values of a snapshot are relative to; values of entries with
+// base kFirstObject + i are relative to the i-th object of the snapshot.
+enum SnapshotBase : uint32_t {
+  kResolveAgain = 0, // e.g. a weak symbol that was not found
+  kAbsolute = 1,
+  kSelf = 2,
+  kSelfModule = 3,
+  kFirstObject = 4,
+};
+
+struct SnapshotEntry {
+  uint32_t base;
+  Elf64_Addr value;
+};
+
+// what a snapshot of a library is recorded and replayed against.
+struct SnapshotContext {
+  std::string key;
+  LoadedObjects objects;
+  // the object each provider searches, nullptr for custom libraries.
+  std::vector<const LoadedObject*> providers;
+
+  // base of the object with `identity` that symbols resolve to: the one a
+  // provider searches, otherwise the only loaded object with that identity.
+  std::optional<Elf64_Addr> object_base(const std::string& identity) const {
+    for (const LoadedObject* object : providers) {
+      if (object && object->identity == identity) {
+        return object->base;
+      }
+    }
+    std::optional<Elf64_Addr> result;
+    for (const auto& object : objects.all()) {
+      if (object.identity == identity) {
+        if (result) {
+          return std::nullopt; // ambiguous
+        }
+        result = object.base;
+      }
+    }
+    return result;
+  }
+};
 
 struct __attribute__((visibility("hidden"))) CustomLibraryImpl
     : public std::enable_shared_from_this<CustomLibraryImpl>,
       public CustomLibrary {
-  CustomLibraryImpl(const char* filename, int argc, const char** argv)
+  CustomLibraryImpl(
+      const char* filename,
+      int argc,
+      const char** argv,
+      const LoaderOptions& options)
       : contents_(filename),
         mapped_library_(nullptr),
         name_(filename),
         argc_(argc),
-        argv_(argv) {
+        argv_(argv),
+        options_(options) {
     pthread_key_create(&tls_key_, nullptr);
     data_ = contents_.data();
     header_ = (Elf64_Ehdr*)data_;
@@ -1036,12 +1747,13 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
     }
 
     // search in this binary first -- equivalent to RTLD_DEEPBIND behavior
-    auto r = sym(sym_name, version);
+    GnuHash hash(sym_name);
+    auto r = dyninfo_.sym(sym_name, &hash);
     if (r) {
       return r;
     }
     for (const auto& sys_lib : symbol_search_path_) {
-      auto r = sys_lib->sym(sym_name, version);
+      auto r = sys_lib->hashed_sym(sym_name, version, hash.hash, hash.name_len);
       if (r) {
         return r;
       }
@@ -1091,41 +1803,57 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
     return std::nullopt;
   }
 
-  void relocate_one(const Elf64_Rela& reloc) {
+  // if `resolved` is given, it is set to the value the relocation was
+  // computed from, see resolve_relocation.
+  void relocate_one(
+      const Elf64_Rela& reloc,
+      std::optional<Elf64_Addr>* resolved = nullptr) {
     const uint32_t r_type = ELF64_R_TYPE(reloc.r_info);
 
     if (r_type == 0) {
       return;
     }
 
-    void* const rel_target =
-        reinterpret_cast<void*>(reloc.r_offset + load_bias_);
+    auto value = resolve_relocation(reloc);
+    if (resolved) {
+      *resolved = value;
+    }
+    if (!value) {
+      return; // skip weak relocation that wasn't found
+    }
+    apply_relocation(reloc, *value);
+  }
 
+  // the value a relocation is computed from: the module_id or the offset of
+  // the symbol for TLS relocations, and the address of the symbol otherwise.
+  // nullopt for a weak symbol that wasn't found.
+  std::optional<Elf64_Addr> resolve_relocation(const Elf64_Rela& reloc) {
+    const uint32_t r_type = ELF64_R_TYPE(reloc.r_info);
     // TLS relocations need to lookup symbols differently so we can get the
     // module_id
     if (r_type == R_X86_64_DTPMOD64 || r_type == R_X86_64_DTPOFF64) {
       auto tls_index = tls_lookup_symbol(reloc.r_info);
       if (!tls_index) {
-        return; // skip weak relocation that wasn't found
+        return std::nullopt;
       }
-      switch (r_type) {
-        case R_X86_64_DTPMOD64:
-          *static_cast<size_t*>(rel_target) = tls_index->module_id;
-          break;
-        case R_X86_64_DTPOFF64:
-          *static_cast<Elf64_Addr*>(rel_target) =
-              tls_index->offset + reloc.r_addend;
-          break;
-      }
-      return;
+      return r_type == R_X86_64_DTPMOD64 ? tls_index->module_id
+                                         : tls_index->offset;
     }
+    return lookup_symbol(reloc.r_info);
+  }
 
-    auto sym_addr = lookup_symbol(reloc.r_info);
-    if (!sym_addr) {
-      return; // skip weak relocation that wasn't found
-    }
+  void apply_relocation(const Elf64_Rela& reloc, Elf64_Addr value) {
+    const uint32_t r_type = ELF64_R_TYPE(reloc.r_info);
+    void* const rel_target =
+        reinterpret_cast<void*>(reloc.r_offset + load_bias_);
 
     switch (r_type) {
+      case R_X86_64_DTPMOD64:
+        *static_cast<size_t*>(rel_target) = value;
+        break;
+      case R_X86_64_DTPOFF64:
+        *static_cast<Elf64_Addr*>(rel_target) = value + reloc.r_addend;
+        break;
       case R_AARCH64_GLOB_DAT:
       case R_AARCH64_JUMP_SLOT:
       case R_AARCH64_TLS_DTPREL:
@@ -1133,7 +1861,7 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
       case R_X86_64_JUMP_SLOT:
       case R_X86_64_64:
       case R_X86_64_GLOB_DAT: {
-        const Elf64_Addr result = *sym_addr + reloc.r_addend;
+        const Elf64_Addr result = value + reloc.r_addend;
         *static_cast<Elf64_Addr*>(rel_target) = result;
       } break;
       case R_AARCH64_RELATIVE:
@@ -1145,11 +1873,11 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
         *static_cast<Elf64_Addr*>(rel_target) = result;
       } break;
       case R_X86_64_32: {
-        const Elf32_Addr result = *sym_addr + reloc.r_addend;
+        const Elf32_Addr result = value + reloc.r_addend;
         *static_cast<Elf32_Addr*>(rel_target) = result;
       } break;
       case R_X86_64_PC32: {
-        const Elf64_Addr target = *sym_addr + reloc.r_addend;
+        const Elf64_Addr target = value + reloc.r_addend;
         const Elf64_Addr base = reinterpret_cast<Elf64_Addr>(rel_target);
         const Elf32_Addr result = target - base;
         *static_cast<Elf32_Addr*>(rel_target) = result;
@@ -1172,12 +1900,438 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
   }
 
   void relocate() {
-    for (const auto i : c10::irange(dyninfo_.n_rela_)) {
-      relocate_one(dyninfo_.rela_[i]);
+    const bool lazy = can_bind_lazily();
+    // snapshots cover rela_, followed by plt_rela_ unless it is bound lazily
+    std::optional<SnapshotContext> snapshot;
+    if (options_.relocation_snapshots) {
+      snapshot = snapshot_context(lazy);
+    }
+    if (!snapshot || !replay_snapshot(*snapshot, lazy)) {
+      std::vector<std::optional<Elf64_Addr>> resolved;
+      if (snapshot) {
+        resolved.resize(dyninfo_.n_rela_ + (lazy ? 0 : dyninfo_.n_plt_rela_));
+      }
+      auto resolved_at = [&](size_t i) {
+        return resolved.empty() ? nullptr : resolved.data() + i;
+      };
+      relocate_all(dyninfo_.rela_, dyninfo_.n_rela_, resolved_at(0));
+      if (!lazy) {
+        relocate_all(
+            dyninfo_.plt_rela_,
+            dyninfo_.n_plt_rela_,
+            resolved_at(dyninfo_.n_rela_));
+      }
+      if (snapshot) {
+        record_snapshot(*snapshot, resolved);
+      }
+    }
+    if (!lazy) {
+      return;
+    }
+    for (const auto i : c10::irange(dyninfo_.n_plt_rela_)) {
+      const Elf64_Rela& reloc = dyninfo_.plt_rela_[i];
+      if (ELF64_R_TYPE(reloc.r_info) == R_X86_64_JUMP_SLOT) {
+        // the GOT entry holds the link time address of the PLT stub that
+        // calls the resolver, which only needs to be rebased.
+        *reinterpret_cast<Elf64_Addr*>(reloc.r_offset + load_bias_) +=
+            load_bias_;
+      } else {
+        relocate_one(reloc);
+      }
+    }
+  }
+
+  // with LoaderOptions::share_pages, maps the pages of the read-only
+  // segments and of PT_GNU_RELRO that relocation changed from the shared
+  // page registry. Pages identical to the file are left alone, they are
+  // still clean and shared with the page cache.
+  void share_read_only_pages() {
+    Elf64_Addr relro_start = 0;
+    Elf64_Addr relro_end = 0;
+    for (const auto i : c10::irange(n_program_headers_)) {
+      const Elf64_Phdr* phdr = &program_headers_[i];
+      if (phdr->p_type == PT_GNU_RELRO) {
+        relro_start = PAGE_START(phdr->p_vaddr + load_bias_);
+        relro_end = PAGE_START(phdr->p_vaddr + load_bias_ + phdr->p_memsz);
+      }
+    }
+
+    for (const auto i : c10::irange(n_program_headers_)) {
+      const Elf64_Phdr* phdr = &program_headers_[i];
+      if (phdr->p_type != PT_LOAD || phdr->p_filesz == 0) {
+        continue;
+      }
+      Elf64_Addr seg_page_start = PAGE_START(phdr->p_vaddr + load_bias_);
+      Elf64_Addr file_page_start = PAGE_START(phdr->p_offset);
+      // only whole pages that are backed by the file
+      Elf64_Addr begin = seg_page_start;
+      Elf64_Addr end = seg_page_start +
+          PAGE_START(phdr->p_offset + phdr->p_filesz - file_page_start);
+      int prot = PFLAGS_TO_PROT(phdr->p_flags);
+      if ((phdr->p_flags & PF_W) != 0) {
+        begin = std::max(begin, relro_start);
+        end = std::min(end, relro_end);
+        prot = PROT_READ;
+      }
+      for (Elf64_Addr page = begin; page < end; page += PAGE_SIZE) {
+        const char* file_page =
+            data_ + file_page_start + (page - seg_page_start);
+        if (memcmp((const void*)page, file_page, PAGE_SIZE) != 0) {
+          share_page(page, prot);
+        }
+      }
+    }
+
+    // pages mapped from the registry are shared with other loads, so RELRO
+    // has to become read-only after the segment protections are applied.
+    if (relro_end > relro_start) {
+      fixup_prot_.emplace_back([=]() {
+        mprotect(
+            reinterpret_cast<void*>(relro_start),
+            relro_end - relro_start,
+            PROT_READ);
+      });
+    }
+  }
+
+  void share_page(Elf64_Addr page, int prot) {
+    const LoaderSharedState* state = loader_shared_state();
+    const void* contents = reinterpret_cast<const void*>(page);
+    uint64_t hash = std::hash<std::string_view>()(
+        std::string_view(static_cast<const char*>(contents), PAGE_SIZE));
+    int fd = -1;
+    uint64_t offset = 0;
+    int existed = state->shared_pages_find_or_add(
+        contents, PAGE_SIZE, hash, &fd, &offset);
+    if (existed < 0) {
+      return;
+    }
+    void* copy = mmap(nullptr, PAGE_SIZE, prot, MAP_SHARED, fd, offset);
+    if (copy == MAP_FAILED) {
+      return;
+    }
+    // mremap replaces our private page only if the move succeeds.
+    if (memcmp(copy, contents, PAGE_SIZE) != 0 ||
+        mremap(
+            copy,
+            PAGE_SIZE,
+            PAGE_SIZE,
+            MREMAP_MAYMOVE | MREMAP_FIXED,
+            reinterpret_cast<void*>(page)) == MAP_FAILED) {
+      munmap(copy, PAGE_SIZE);
+      return;
+    }
+    shared_bytes_ += PAGE_SIZE;
+    if (existed) {
+      saved_bytes_ += PAGE_SIZE;
+      state->shared_pages_add_saved(PAGE_SIZE);
+    }
+  }
+
+  // applies relocs[0, n), in chunks spread over options_.relocation_threads
+  // when the table is large enough to be worth it. Each relocation writes
+  // its own target, so the result does not depend on the order. If any
+  // chunk fails, the error of the first failing chunk is rethrown.
+  void relocate_all(
+      const Elf64_Rela* relocs,
+      size_t n,
+      std::optional<Elf64_Addr>* resolved = nullptr) {
+    constexpr size_t kChunkSize = 4096;
+    const size_t n_chunks = (n + kChunkSize - 1) / kChunkSize;
+    const size_t n_threads = std::min(
+        options_.relocation_threads ? options_.relocation_threads
+                                    : default_relocation_threads(),
+        n_chunks / 4);
+    relocation_threads_used_ = std::max<size_t>(relocation_threads_used_, 1);
+    if (n_threads <= 1) {
+      for (const auto i : c10::irange(n)) {
+        relocate_one(relocs[i], resolved ? resolved + i : nullptr);
+      }
+      return;
+    }
+    relocation_threads_used_ = std::max(relocation_threads_used_, n_threads);
+
+    std::atomic<size_t> next_chunk{0};
+    std::vector<std::exception_ptr> errors(n_chunks);
+    auto work = [&]() {
+      for (size_t chunk = next_chunk++; chunk < n_chunks;
+           chunk = next_chunk++) {
+        try {
+          const size_t end = std::min(n, (chunk + 1) * kChunkSize);
+          for (size_t i = chunk * kChunkSize; i < end; ++i) {
+            relocate_one(relocs[i], resolved ? resolved + i : nullptr);
+          }
+        } catch (...) {
+          errors[chunk] = std::current_exception();
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads - 1);
+    for (size_t i = 1; i < n_threads; ++i) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+      worker.join();
     }
+    for (const auto& error : errors) {
+      if (error) {
+        std::rethrow_exception(error);
+      }
+    }
+  }
+
+  const Elf64_Rela& snapshot_relocation(size_t i) const {
+    return i < dyninfo_.n_rela_ ? dyninfo_.rela_[i]
+                                : dyninfo_.plt_rela_[i - dyninfo_.n_rela_];
+  }
+
+  // build-id of the file, or its inode and modification time if it has none.
+  std::string file_identity() const {
+    std::string build_id = read_build_id(
+        program_headers_, n_program_headers_, [&](const Elf64_Phdr& phdr) {
+          return data_ + phdr.p_offset;
+        });
+    if (!build_id.empty()) {
+      return build_id;
+    }
+    struct stat st;
+    if (fstat(contents_.fd(), &st) != 0) {
+      return "";
+    }
+    return fmt::format(
+        "file:{}:{}:{}:{}",
+        st.st_dev,
+        st.st_ino,
+        st.st_size,
+        st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec);
+  }
+
+  // the key identifies everything the resolved values depend on: the host
+  // binary, this library and what each provider searches. nullopt if this
+  // library cannot be snapshotted.
+  std::optional<SnapshotContext> snapshot_context(bool lazy) const {
+    SnapshotContext context;
+    std::string identity = file_identity();
+    if (context.objects.all().empty() || identity.empty()) {
+      return std::nullopt;
+    }
+    // the first object is the main program
+    context.key = fmt::format(
+        "host:{};library:{};lazy:{}",
+        context.objects.all()[0].identity,
+        identity,
+        lazy);
+    for (const auto& provider : symbol_search_path_) {
+      auto system = dynamic_cast<const SystemLibraryImpl*>(provider.get());
+      auto custom = dynamic_cast<const CustomLibraryImpl*>(provider.get());
+      if (system) {
+        const LoadedObject* object = nullptr;
+        if (system->handle() == RTLD_DEFAULT) {
+          // with RTLD_DEEPBIND, RTLD_DEFAULT searches the library containing
+          // this code first.
+          object = context.objects.containing((Elf64_Addr)&__dso_handle);
+        } else {
+          struct link_map* lm = nullptr;
+          if (dlinfo(system->handle(), RTLD_DI_LINKMAP, &lm) == 0 && lm) {
+            object = context.objects.containing((Elf64_Addr)lm->l_ld);
+          }
+        }
+        if (!object) {
+          return std::nullopt;
+        }
+        context.providers.push_back(object);
+        context.key += fmt::format(
+            ";{}:{}",
+            system->handle() == RTLD_DEFAULT ? "default" : "system",
+            object->identity);
+      } else if (custom) {
+        std::string custom_identity = custom->file_identity();
+        if (custom_identity.empty()) {
+          return std::nullopt;
+        }
+        context.providers.push_back(nullptr);
+        context.key += ";custom:" + custom_identity;
+      } else {
+        return std::nullopt;
+      }
+    }
+    return context;
+  }
+
+  // stores how each resolved value is derived from a base. Nothing is
+  // recorded if a value points somewhere a later load could not locate,
+  // e.g. into another library loaded by this loader.
+  void record_snapshot(
+      const SnapshotContext& context,
+      const std::vector<std::optional<Elf64_Addr>>& resolved) {
+    const Elf64_Addr self_begin = (Elf64_Addr)mapped_library_;
+    const Elf64_Addr self_end = self_begin + mapped_size_;
+    std::vector<std::string> identities;
+    std::unordered_map<const LoadedObject*, uint32_t> object_index;
+    std::vector<SnapshotEntry> entries(resolved.size());
+    for (const auto i : c10::irange(resolved.size())) {
+      const Elf64_Rela& reloc = snapshot_relocation(i);
+      const uint32_t r_type = ELF64_R_TYPE(reloc.r_info);
+      if (!resolved[i]) {
+        entries[i] = {kResolveAgain, 0};
+        continue;
+      }
+      const Elf64_Addr value = *resolved[i];
+      if (r_type == R_X86_64_DTPMOD64) {
+        entries[i] = value == module_id() ? SnapshotEntry{kSelfModule, 0}
+                                          : SnapshotEntry{kAbsolute, value};
+      } else if (
+          r_type == R_X86_64_DTPOFF64 || ELF64_R_SYM(reloc.r_info) == 0) {
+        entries[i] = {kAbsolute, value};
+      } else if (value >= self_begin && value < self_end) {
+        entries[i] = {kSelf, value - load_bias_};
+      } else {
+        const LoadedObject* object = context.objects.containing(value);
+        if (!object || context.object_base(object->identity) != object->base) {
+          return;
+        }
+        auto it = object_index.find(object);
+        if (it == object_index.end()) {
+          it = object_index.emplace(object, identities.size()).first;
+          identities.push_back(object->identity);
+        }
+        entries[i] = {kFirstObject + it->second, value - object->base};
+      }
+    }
+
+    std::string data;
+    auto append = [&](const void* bytes, size_t size) {
+      data.append(static_cast<const char*>(bytes), size);
+    };
+    uint64_t n_identities = identities.size();
+    append(&n_identities, sizeof(n_identities));
+    for (const auto& identity : identities) {
+      uint64_t size = identity.size();
+      append(&size, sizeof(size));
+      append(identity.data(), size);
+    }
+    uint64_t n_entries = entries.size();
+    append(&n_entries, sizeof(n_entries));
+    append(entries.data(), entries.size() * sizeof(SnapshotEntry));
+    loader_shared_state()->relocation_snapshot_add(
+        context.key.c_str(), data.data(), data.size());
+  }
+
+  // applies the relocations from the snapshot recorded for the context.
+  // Returns false, without changing anything, if there is none or an object
+  // it refers to cannot be found.
+  bool replay_snapshot(const SnapshotContext& context, bool lazy) {
+    const char* data = nullptr;
+    size_t size = 0;
+    if (!loader_shared_state()->relocation_snapshot_find(
+            context.key.c_str(), &data, &size)) {
+      return false;
+    }
+    const char* end = data + size;
+    auto read = [&](void* out, size_t n) {
+      if ((size_t)(end - data) < n) {
+        return false;
+      }
+      memcpy(out, data, n);
+      data += n;
+      return true;
+    };
+
+    std::vector<Elf64_Addr> bases(kFirstObject);
+    bases[kAbsolute] = 0;
+    bases[kSelf] = load_bias_;
+    bases[kSelfModule] = module_id();
+    uint64_t n_identities = 0;
+    if (!read(&n_identities, sizeof(n_identities))) {
+      return false;
+    }
+    for (const auto i : c10::irange(n_identities)) {
+      (void)i;
+      uint64_t identity_size = 0;
+      if (!read(&identity_size, sizeof(identity_size)) ||
+          (size_t)(end - data) < identity_size) {
+        return false;
+      }
+      auto base = context.object_base(std::string(data, identity_size));
+      data += identity_size;
+      if (!base) {
+        return false;
+      }
+      bases.push_back(*base);
+    }
+    uint64_t n_entries = 0;
+    const size_t expected =
+        dyninfo_.n_rela_ + (lazy ? 0 : dyninfo_.n_plt_rela_);
+    if (!read(&n_entries, sizeof(n_entries)) || n_entries != expected ||
+        (size_t)(end - data) != n_entries * sizeof(SnapshotEntry)) {
+      return false;
+    }
+
+    for (const auto i : c10::irange(n_entries)) {
+      const Elf64_Rela& reloc = snapshot_relocation(i);
+      SnapshotEntry entry;
+      read(&entry, sizeof(entry)); // the data is not aligned
+      if (entry.base == kResolveAgain) {
+        relocate_one(reloc);
+      } else {
+        apply_relocation(reloc, bases[entry.base] + entry.value);
+      }
+    }
+    relocations_replayed_ = true;
+    return true;
+  }
+
+  bool can_bind_lazily() {
+#ifdef __x86_64__
+    if (!options_.lazy_binding || !lazy_binding_supported() ||
+        !dyninfo_.plt_got_ || dyninfo_.bind_now_) {
+      return false;
+    }
+    // libraries built without lazy PLT stubs (e.g. -fno-plt) leave their
+    // GOT entries empty.
     for (const auto i : c10::irange(dyninfo_.n_plt_rela_)) {
-      relocate_one(dyninfo_.plt_rela_[i]);
+      const Elf64_Rela& reloc = dyninfo_.plt_rela_[i];
+      if (ELF64_R_TYPE(reloc.r_info) == R_X86_64_JUMP_SLOT &&
+          *reinterpret_cast<Elf64_Addr*>(reloc.r_offset + load_bias_) == 0) {
+        return false;
+      }
     }
+    dyninfo_.plt_got_[1] = reinterpret_cast<Elf64_Addr>(this);
+    dyninfo_.plt_got_[2] =
+        reinterpret_cast<Elf64_Addr>(deploy_lazy_bind_trampoline);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // called by deploy_lazy_bind_trampoline the first time the function of
+  // PLT entry `index` is called.
+  Elf64_Addr lazy_bind(size_t index) noexcept {
+    const Elf64_Rela& reloc = dyninfo_.plt_rela_[index];
+    std::optional<Elf64_Addr> sym_addr;
+    try {
+      sym_addr = lookup_symbol(reloc.r_info);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      abort();
+    }
+    if (!sym_addr) {
+      std::cerr << fmt::format(
+          "{}: called undefined weak function '{}'\n",
+          name_,
+          dyninfo_.get_string(
+              dyninfo_.symtab_[ELF64_R_SYM(reloc.r_info)].st_name));
+      abort();
+    }
+    const Elf64_Addr result = *sym_addr + reloc.r_addend;
+    __atomic_store_n(
+        reinterpret_cast<Elf64_Addr*>(reloc.r_offset + load_bias_),
+        result,
+        __ATOMIC_RELEASE);
+    return result;
   }
 
   void initialize() {
@@ -1217,16 +2371,58 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
   }
 
   void load() override {
+    auto begin = std::chrono::steady_clock::now();
+    auto phase_begin = begin;
     check_library_format();
     reserve_address_space();
+    timings_.reserve = elapsed_since(phase_begin);
     load_segments();
+    timings_.map_segments = elapsed_since(phase_begin);
     read_dynamic_section();
     relocate();
+    if (options_.share_pages) {
+      share_read_only_pages();
+    }
+    timings_.relocate = elapsed_since(phase_begin);
     protect();
     __register_frame(eh_frame_);
     eh_frame_registered_ = true;
     register_debug_info();
     initialize();
+    timings_.initialize = elapsed_since(phase_begin);
+    timings_.total = std::chrono::duration_cast<std::chrono::microseconds>(
+        phase_begin - begin);
+    if (options_.print_timings) {
+      std::cerr << fmt::format(
+          "{}: loaded in {}us (reserve {}us, map segments {}us, relocate {}us "
+          "on {} threads, init {}us)\n",
+          name_,
+          timings_.total.count(),
+          timings_.reserve.count(),
+          timings_.map_segments.count(),
+          timings_.relocate.count(),
+          relocation_threads_used_,
+          timings_.initialize.count());
+      if (relocations_replayed_) {
+        std::cerr << fmt::format(
+            "{}: relocations replayed from a snapshot\n", name_);
+      }
+      if (options_.share_pages) {
+        std::cerr << fmt::format(
+            "{}: {} bytes of relocated pages shared, {} bytes saved\n",
+            name_,
+            shared_bytes_,
+            saved_bytes_);
+      }
+    }
+  }
+
+  const LoadTimings& load_timings() const override {
+    return timings_;
+  }
+
+  bool relocations_replayed() const override {
+    return relocations_replayed_;
   }
 
   ~CustomLibraryImpl() override {
@@ -1264,6 +2460,15 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
     return dyninfo_.sym(name);
   }
 
+  std::optional<Elf64_Addr> hashed_sym(
+      const char* name,
+      const char* version,
+      uint32_t gnu_hash,
+      uint32_t name_len) const override {
+    GnuHash hash(gnu_hash, name_len);
+    return dyninfo_.sym(name, &hash);
+  }
+
   std::optional<TLSIndex> tls_sym(const char* name) const override {
     auto r = dyninfo_.sym(name);
     if (r) {
@@ -1305,6 +2510,7 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
   std::string name_;
   int argc_ = 0;
   const char** argv_ = nullptr;
+  const LoaderOptions options_;
   bool initialized_ = false;
   bool eh_frame_registered_ = false;
 
@@ -1315,11 +2521,31 @@ struct __attribute__((visibility("hidden"))) CustomLibraryImpl
 
   std::vector<std::shared_ptr<SymbolProvider>> symbol_search_path_;
   std::vector<std::function<void(void)>> fixup_prot_;
+
+  LoadTimings timings_;
+  size_t relocation_threads_used_ = 0;
+  size_t shared_bytes_ = 0;
+  size_t saved_bytes_ = 0;
+  bool relocations_replayed_ = false;
 };
 
-std::shared_ptr<CustomLibrary>
-CustomLibrary::create(const char* filename, int argc, const char** argv) {
-  return std::make_shared<CustomLibraryImpl>(filename, argc, argv);
+#ifdef __x86_64__
+extern "C" __attribute__((visibility("hidden"), used)) Elf64_Addr
+deploy_lazy_bind_resolve(CustomLibraryImpl* library, size_t index) {
+  return library->lazy_bind(index);
+}
+#endif
+
+std::shared_ptr<CustomLibrary> CustomLibrary::create(
+    const char* filename,
+    int argc,
+    const char** argv,
+    const LoaderOptions& options) {
+  return std::make_shared<CustomLibraryImpl>(filename, argc, argv, options);
+}
+
+size_t CustomLibrary::shared_bytes_saved() {
+  return loader_shared_state()->shared_pages_saved();
 }
 
 static void* local__tls_get_addr(TLSIndex* idx) {
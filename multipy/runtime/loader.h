@@ -7,8 +7,10 @@
 #pragma once
 #include <dlfcn.h>
 #include <elf.h>
+#include <chrono>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 
 namespace torch {
 namespace deploy {
@@ -28,6 +30,15 @@ struct SymbolProvider {
   virtual std::optional<Elf64_Addr> sym(
       const char* name,
       const char* version = nullptr) const = 0;
+  // sym() for callers that already computed the GNU hash and the length of
+  // name, which providers can use instead of hashing the name again.
+  virtual std::optional<Elf64_Addr> hashed_sym(
+      const char* name,
+      const char* version,
+      uint32_t gnu_hash,
+      uint32_t name_len) const {
+    return sym(name, version);
+  }
   virtual std::optional<TLSIndex> tls_sym(const char* name) const = 0;
   SymbolProvider(const SymbolProvider&) = delete;
   SymbolProvider& operator=(const SymbolProvider&) = delete;
@@ -44,13 +55,74 @@ struct SystemLibrary : public SymbolProvider {
   static std::shared_ptr<SystemLibrary> create(const char* path, int flags);
 };
 
+// time spent in each phase of CustomLibrary::load
+struct LoadTimings {
+  // reserving address space for the library
+  std::chrono::microseconds reserve{0};
+  // mapping its segments
+  std::chrono::microseconds map_segments{0};
+  // finding its dependencies and applying relocations
+  std::chrono::microseconds relocate{0};
+  // protecting segments and running initializers
+  std::chrono::microseconds initialize{0};
+  std::chrono::microseconds total{0};
+};
+
+// how CustomLibrary::load maps and relocates a library. the defaults of
+// CustomLibrary::create are taken from the MULTIPY_* environment variables
+// until set_defaults replaces them. they are shared with the loaders of the
+// interpreters, so they also apply to the python extensions they load.
+struct LoaderOptions {
+  // on x86_64, defer resolving functions called through the PLT until their
+  // first call, like RTLD_LAZY. MULTIPY_LAZY_BINDING=1.
+  bool lazy_binding = false;
+  // number of threads applying large relocation tables, 0 picks it from the
+  // number of cores and 1 applies them serially. MULTIPY_LOADER_THREADS.
+  size_t relocation_threads = 0;
+  // share relocated pages that are read-only once loaded between loads that
+  // produce the same contents. MULTIPY_SHARE_LIBRARY_PAGES=1.
+  bool share_pages = false;
+  // let later loads of a library against the same libraries reuse the
+  // symbols resolved by the first one. MULTIPY_RELOCATION_SNAPSHOTS=1.
+  bool relocation_snapshots = false;
+  // print the load_timings of every load to stderr. MULTIPY_LOADER_TIMINGS=1.
+  bool print_timings = false;
+
+  static LoaderOptions defaults();
+  static void set_defaults(const LoaderOptions& options);
+};
+
 struct CustomLibrary : public SymbolProvider {
-  static std::shared_ptr<CustomLibrary>
-  create(const char* filename, int argc = 0, const char** argv = nullptr);
+  static std::shared_ptr<CustomLibrary> create(
+      const char* filename,
+      int argc = 0,
+      const char** argv = nullptr,
+      const LoaderOptions& options = LoaderOptions::defaults());
   virtual void add_search_library(std::shared_ptr<SymbolProvider> lib) = 0;
+  // maps and relocates the library and runs its initializers, see
+  // LoaderOptions.
   virtual void load() = 0;
+  virtual const LoadTimings& load_timings() const = 0;
+  // true if load() applied the relocations from a snapshot of an earlier load
+  // instead of resolving their symbols.
+  virtual bool relocations_replayed() const = 0;
+  // returns how many bytes of pages were mapped from an existing copy
+  // instead of being duplicated because of LoaderOptions::share_pages, across
+  // all libraries in the process.
+  static size_t shared_bytes_saved();
 };
 
+// state of the custom loader shared by all interpreters: the symbol cache,
+// the shared pages and the relocation snapshots. Every interpreter library has
+// its own copy of the loader, which uses the state of the host once it is
+// passed to the exported deploy_set_loader_shared_state.
+struct LoaderSharedState;
+const LoaderSharedState* loader_shared_state();
+// hold every lock of the shared state across fork(), so that the child does
+// not inherit one locked by a thread that no longer exists.
+void loader_lock_for_fork();
+void loader_unlock_after_fork(bool child);
+
 using SystemLibraryPtr = std::shared_ptr<SystemLibrary>;
 using CustomLibraryPtr = std::shared_ptr<CustomLibrary>;
 
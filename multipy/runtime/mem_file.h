@@ -11,14 +11,32 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <cerrno>
 #include <cstdio>
 #include <iostream>
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
 namespace torch {
 namespace deploy {
 
+/// Creates an anonymous memory file named `name` with memfd_create, closed on
+/// exec. glibc only wraps memfd_create since 2.27, so it is called through
+/// syscall. Returns -1 if the kernel or its headers do not support it, in
+/// which case callers fall back to a temporary file.
+inline int memfdCreate(const char* name) {
+#ifdef __NR_memfd_create
+  return static_cast<int>(syscall(__NR_memfd_create, name, MFD_CLOEXEC));
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 /// Memory maps a file into the address space read-only, and manages the
 /// lifetime of the mapping. Here are a few use cases:
 /// 1. Used in the loader to read in initial image, and to inspect
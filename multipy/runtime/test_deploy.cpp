@@ -7,16 +7,20 @@
 #include <ATen/Parallel.h>
 #include <gtest/gtest.h>
 #include <libgen.h>
+#include <sys/wait.h>
 #include <cstring>
 
 #include <c10/util/irange.h>
 #include <libgen.h>
+#include <multipy/runtime/batching.h>
 #include <multipy/runtime/deploy.h>
+#include <multipy/runtime/loader.h>
 #include <torch/script.h>
 #include <torch/torch.h>
 
 #include <future>
 #include <iostream>
+#include <set>
 #include <string>
 
 void compare_torchpy_jit(const char* model_filename, const char* jit_filename) {
@@ -69,6 +73,60 @@ TEST(TorchpyTest, InitTwice) {
   { torch::deploy::InterpreterManager m(1); }
 }
 
+TEST(TorchpyTest, StartupTimings) {
+  auto begin = std::chrono::steady_clock::now();
+  torch::deploy::InterpreterManager m(4);
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+  ASSERT_LE(m.startupTime(), elapsed);
+  std::chrono::microseconds interpreters{0};
+  for (auto& interp : m.allInstances()) {
+    const auto& timings = interp.startupTimings();
+    ASSERT_GT(timings.initialize.count(), 0);
+    ASSERT_GE(
+        timings.total, timings.extract + timings.load + timings.initialize);
+    ASSERT_LE(timings.libraries.total, timings.initialize);
+    interpreters += timings.total;
+  }
+  // the interpreters are created one after the other.
+  ASSERT_GE(m.startupTime(), interpreters);
+}
+
+TEST(TorchpyTest, SharedLibraryPages) {
+  auto defaults = torch::deploy::LoaderOptions::defaults();
+  auto options = defaults;
+  options.share_pages = true;
+  torch::deploy::LoaderOptions::set_defaults(options);
+  size_t savedBefore = torch::deploy::CustomLibrary::shared_bytes_saved();
+  size_t savedAfter = 0;
+  {
+    // both interpreters load libtorch_python with the same relocated GOT.
+    torch::deploy::InterpreterManager m(2);
+    savedAfter = m.sharedLibraryBytesSaved();
+  }
+  torch::deploy::LoaderOptions::set_defaults(defaults);
+  ASSERT_GT(savedAfter, savedBefore);
+}
+
+TEST(TorchpyTest, ParallelInit) {
+  for (auto initMode :
+       {torch::deploy::InterpreterInitMode::Parallel,
+        torch::deploy::InterpreterInitMode::ParallelLoad}) {
+    torch::deploy::InterpreterManager m(
+        4,
+        std::make_shared<torch::deploy::NoopEnvironment>(),
+        torch::deploy::LoadBalancerPolicy::WorkStealing,
+        initMode);
+    std::set<int64_t> interps;
+    for (auto& interp : m.allInstances()) {
+      auto I = interp.acquireSession();
+      auto version = I.global("torch", "version");
+      interps.insert(version.attr("interp").toIValue().toInt());
+    }
+    ASSERT_EQ(interps, (std::set<int64_t>{0, 1, 2, 3}));
+  }
+}
+
 TEST(TorchpyTest, DifferentInterps) {
   torch::deploy::InterpreterManager m(2);
   m.registerModuleSource("check_none", "check = id(None)\n");
@@ -119,6 +177,245 @@ TEST(TorchpyTest, Movable) {
   obj.acquireSession();
 }
 
+TEST(TorchpyTest, MovableUnloadedLazily) {
+  torch::deploy::InterpreterManager m(2);
+  auto countLoaded = [](torch::deploy::InterpreterSession& I) {
+    auto objects = I.global("multipy.utils._deploy", "_deploy_objects");
+    return I.global("builtins", "len")({objects}).toIValue().toInt();
+  };
+  {
+    torch::deploy::ReplicatedObj obj;
+    {
+      auto I = m.acquireOne();
+      auto model =
+          I.global("torch.nn", "Module")(std::vector<torch::deploy::Obj>());
+      obj = m.createMovable(model, &I);
+    }
+    obj.warmup();
+  }
+  // the replicas are dropped by collect() or when each interpreter is next
+  // acquired.
+  m.collect();
+  for (auto& interp : m.allInstances()) {
+    auto I = interp.acquireSession();
+    ASSERT_EQ(countLoaded(I), 0);
+  }
+}
+
+TEST(TorchpyTest, MovableUnloadedOnNextSession) {
+  torch::deploy::InterpreterManager m(1);
+  auto& interp = m.allInstances()[0];
+  auto countLoaded = [](torch::deploy::InterpreterSession& I) {
+    auto objects = I.global("multipy.utils._deploy", "_deploy_objects");
+    return I.global("builtins", "len")({objects}).toIValue().toInt();
+  };
+  {
+    torch::deploy::ReplicatedObj obj;
+    {
+      auto I = interp.acquireSession();
+      auto model =
+          I.global("torch.nn", "Module")(std::vector<torch::deploy::Obj>());
+      obj = m.createMovable(model, &I);
+    }
+    auto I = obj.acquireSession(&interp);
+    ASSERT_EQ(countLoaded(I), 1);
+  }
+  // any session on the interpreter drops the replica, without collect().
+  auto I = interp.acquireSession();
+  ASSERT_EQ(countLoaded(I), 0);
+}
+
+TEST(TorchpyTest, MovableWarmup) {
+  torch::deploy::InterpreterManager m(3);
+  torch::deploy::Package p = m.loadPackage(path("SIMPLE", simple));
+  auto model = p.loadPickle("model", "model.pkl");
+
+  auto timings = model.warmup();
+  ASSERT_EQ(timings.size(), m.allInstances().size());
+
+  // every interpreter already holds the model, before it is ever called
+  for (auto& interp : m.allInstances()) {
+    auto I = interp.acquireSession();
+    auto objects = I.global("multipy.utils._deploy", "_deploy_objects");
+    ASSERT_EQ(I.global("builtins", "len")({objects}).toIValue().toInt(), 1);
+  }
+
+  auto input = torch::ones({10, 20});
+  auto expected = model({input.alias()}).toTensor();
+  for (auto& interp : m.allInstances()) {
+    auto I = model.acquireSession(&interp);
+    ASSERT_TRUE(expected.equal(I.self({input.alias()}).toIValue().toTensor()));
+  }
+}
+
+TEST(TorchpyTest, ForkWarmedInterpreters) {
+  torch::deploy::InterpreterManager m(2);
+  torch::deploy::Package p = m.loadPackage(path("SIMPLE", simple));
+  auto model = p.loadPickle("model", "model.pkl");
+  model.warmup();
+
+  auto input = torch::ones({10, 20});
+  auto expected = model({input.alias()}).toTensor();
+
+  pid_t pid = m.fork();
+  if (pid == 0) {
+    // gtest assertions cannot report from the child, use the exit status
+    int status = 1;
+    try {
+      for (auto& interp : m.allInstances()) {
+        auto I = model.acquireSession(&interp);
+        if (!expected.equal(I.self({input.alias()}).toIValue().toTensor())) {
+          _exit(1);
+        }
+      }
+      // the locks held across the fork are released in the child: those of
+      // the manager, of the extracted files and of the custom loader.
+      {
+        auto I = p.acquireSession();
+        auto obj = I.self.attr("load_pickle")({"model", "model.pkl"});
+        p.createMovable(obj, &I, /*deduplicate*/ true);
+      }
+      torch::deploy::InterpreterManager other(1);
+      status = 0;
+    } catch (...) {
+      status = 2;
+    }
+    _exit(status);
+  }
+  ASSERT_GT(pid, 0);
+  int status = 0;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+
+  // the parent keeps working after the fork
+  ASSERT_TRUE(expected.equal(model({input.alias()}).toTensor()));
+}
+
+TEST(TorchpyTest, MovableAffinity) {
+  torch::deploy::InterpreterManager m(3);
+  m.registerModuleSource("check_none", "check = id(None)\n");
+  m.registerModuleSource(
+      "affinity_sync", "import threading\nshared = threading.Event()\n");
+  auto interpreterId = [](torch::deploy::InterpreterSession& I) {
+    return I.global("check_none", "check").toIValue().toInt();
+  };
+  for (auto policy :
+       {torch::deploy::ReplicaAffinityPolicy::Pinned,
+        torch::deploy::ReplicaAffinityPolicy::PreferLoaded}) {
+    torch::deploy::ReplicatedObj obj;
+    {
+      auto I = m.acquireOne();
+      auto model =
+          I.global("torch.nn", "Module")(std::vector<torch::deploy::Obj>());
+      obj = m.createMovable(model, &I);
+    }
+    obj.setAffinity({policy, 1});
+
+    int64_t first = 0;
+    std::future<int64_t> concurrent;
+    {
+      auto I = obj.acquireSession();
+      first = interpreterId(I);
+      auto shared = I.global("affinity_sync", "shared");
+      shared.attr("clear")(std::vector<torch::deploy::Obj>());
+      // the only replica is busy, so this call has to share it. It sets the
+      // event this session waits on, with the GIL released, so it always runs
+      // while the session is held.
+      concurrent = std::async(std::launch::async, [&]() {
+        auto I2 = obj.acquireSession();
+        I2.global("affinity_sync", "shared")
+            .attr("set")(std::vector<torch::deploy::Obj>());
+        return interpreterId(I2);
+      });
+      ASSERT_TRUE(
+          shared.attr("wait")({at::IValue(10.0)}).toIValue().toBool());
+    }
+    ASSERT_EQ(concurrent.get(), first);
+    for (const auto i : c10::irange(3)) {
+      (void)i;
+      auto I = obj.acquireSession();
+      ASSERT_EQ(interpreterId(I), first);
+    }
+  }
+}
+
+TEST(LoadBalancerTest, WorkStealingHandsOverFreedInterpreter) {
+  torch::deploy::LoadBalancer balancer(
+      2, torch::deploy::LoadBalancerPolicy::WorkStealing);
+  int first = balancer.acquire();
+  int second = balancer.acquire();
+  ASSERT_NE(first, second);
+
+  // both interpreters are busy, so the waiter must queue instead of piling on
+  // to one of them.
+  auto waiter = std::async(std::launch::async, [&balancer]() {
+    int where = balancer.acquire();
+    balancer.free(where);
+    return where;
+  });
+  ASSERT_EQ(
+      waiter.wait_for(std::chrono::milliseconds(50)),
+      std::future_status::timeout);
+
+  balancer.free(second);
+  ASSERT_EQ(waiter.get(), second);
+  balancer.free(first);
+}
+
+TEST(LoadBalancerTest, WorkStealingNestedAcquireDoesNotBlock) {
+  torch::deploy::LoadBalancer balancer(
+      1, torch::deploy::LoadBalancerPolicy::WorkStealing);
+  int outer = balancer.acquire();
+  // the calling thread already holds the only interpreter, waiting for it
+  // would deadlock.
+  int inner = balancer.acquire();
+  ASSERT_EQ(outer, inner);
+  balancer.free(inner);
+  balancer.free(outer);
+}
+
+TEST(LoadBalancerTest, WorkStealingFreeOnAnotherThread) {
+  torch::deploy::LoadBalancer balancer(
+      1, torch::deploy::LoadBalancerPolicy::WorkStealing);
+  const auto holder = std::this_thread::get_id();
+  int moved = balancer.acquire();
+  // the session moved to another thread, which frees it for this thread.
+  std::async(std::launch::async, [&balancer, moved, holder]() {
+    balancer.free(moved, holder);
+  }).get();
+
+  std::atomic<bool> released{false};
+  std::promise<void> acquired;
+  auto other = std::async(std::launch::async, [&]() {
+    int where = balancer.acquire();
+    acquired.set_value();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    released = true;
+    balancer.free(where);
+  });
+  acquired.get_future().wait();
+  // this thread holds nothing anymore, so it waits for the interpreter
+  // instead of sharing it.
+  int where = balancer.acquire();
+  ASSERT_TRUE(released);
+  balancer.free(where);
+  other.get();
+}
+
+TEST(LoadBalancerTest, LeastLoadedSharesBusyInterpreter) {
+  torch::deploy::LoadBalancer balancer(
+      1, torch::deploy::LoadBalancerPolicy::LeastLoaded);
+  int first = balancer.acquire();
+  int second =
+      std::async(std::launch::async, [&balancer]() {
+        return balancer.acquire();
+      }).get();
+  ASSERT_EQ(first, second);
+  balancer.free(second);
+  balancer.free(first);
+}
+
 TEST(TorchpyTest, MultiSerialSimpleModel) {
   torch::deploy::InterpreterManager manager(3);
   torch::deploy::Package p = manager.loadPackage(path("SIMPLE", simple));
@@ -158,6 +455,101 @@ TEST(TorchpyTest, MultiSerialSimpleModel) {
   // test hasattr
   ASSERT_TRUE(model.hasattr("forward"));
   ASSERT_FALSE(model.hasattr("make_prediction"));
+
+  // and with a bound signature, positionally and by keyword
+  auto byPosition =
+      model.bind({{{"input", torch::deploy::ArgKind::Tensor}}, {}}, "forward");
+  auto byKeyword =
+      model.bind({{}, {{"input", torch::deploy::ArgKind::Tensor}}}, "forward");
+  for (const auto i : c10::irange(ninterp)) {
+    (void)i;
+    ASSERT_TRUE(ref_output.equal(byPosition({input}).toTensor()));
+    ASSERT_TRUE(ref_output.equal(byKeyword({input}).toTensor()));
+  }
+  EXPECT_THROW(byKeyword({at::IValue(1)}), std::runtime_error);
+  EXPECT_THROW(byKeyword({}), std::runtime_error);
+}
+
+TEST(TorchpyTest, CallMany) {
+  torch::deploy::InterpreterManager manager(2);
+  manager.registerModuleSource("transforms", R"PYTHON(
+def double(x):
+    return x * 2
+
+def fail(x):
+    raise ValueError("bad input")
+)PYTHON");
+  torch::deploy::ReplicatedObj doubleFn, failFn;
+  {
+    auto I = manager.acquireOne();
+    doubleFn = manager.createMovable(I.global("transforms", "double"), &I);
+    failFn = manager.createMovable(I.global("transforms", "fail"), &I);
+  }
+
+  std::vector<std::pair<torch::deploy::ReplicatedObj, std::vector<at::IValue>>>
+      calls = {{doubleFn, {at::IValue(1)}},
+               {failFn, {at::IValue(2)}},
+               {doubleFn, {torch::ones({2})}}};
+  auto results = manager.callMany(calls);
+  ASSERT_EQ(results.size(), 3);
+  ASSERT_TRUE(results[0].ok());
+  ASSERT_EQ(results[0].value.toInt(), 2);
+  ASSERT_FALSE(results[1].ok());
+  ASSERT_NE(results[1].error->find("bad input"), std::string::npos);
+  ASSERT_TRUE(results[2].ok());
+  ASSERT_TRUE(results[2].value.toTensor().equal(torch::full({2}, 2.)));
+
+  // concurrent batches of calls each run in their own session.
+  std::vector<std::future<void>> futures;
+  for (const auto t : c10::irange(8)) {
+    auto caller = [&manager, &doubleFn, t]() {
+      for (const auto i : c10::irange(20)) {
+        std::vector<
+            std::pair<torch::deploy::ReplicatedObj, std::vector<at::IValue>>>
+            calls = {{doubleFn, {at::IValue(int64_t(t * 100 + i))}},
+                     {doubleFn, {at::IValue(int64_t(i))}}};
+        auto results = manager.callMany(calls);
+        ASSERT_TRUE(results[0].ok());
+        ASSERT_EQ(results[0].value.toInt(), 2 * (t * 100 + i));
+        ASSERT_EQ(results[1].value.toInt(), 2 * i);
+      }
+    };
+    futures.push_back(std::async(std::launch::async, caller));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+
+  // objects of another session are rejected.
+  auto I0 = manager.allInstances()[0].acquireSession();
+  auto I1 = manager.allInstances()[1].acquireSession();
+  std::vector<at::IValue> args = {at::IValue(1)};
+  std::vector<std::pair<torch::deploy::Obj, at::ArrayRef<at::IValue>>>
+      foreign = {{I0.global("transforms", "double"), args}};
+  EXPECT_THROW(I1.callMany(foreign), std::runtime_error);
+}
+
+TEST(TorchpyTest, PythonMethodWrapper) {
+  torch::deploy::InterpreterManager manager(2);
+  torch::deploy::Package p = manager.loadPackage(path("SIMPLE", simple));
+  auto model = p.loadPickle("model", "model.pkl");
+  auto ref_model = torch::jit::load(path("SIMPLE_JIT", simple_jit));
+
+  auto input = torch::ones({10, 20});
+  auto ref_output = ref_model.forward({input.alias()}).toTensor();
+
+  torch::deploy::PythonMethodWrapper forward(model, "forward");
+  for (const auto i : c10::irange(4)) {
+    (void)i;
+    ASSERT_TRUE(ref_output.equal(forward({input.alias()}).toTensor()));
+  }
+  ASSERT_EQ(forward.getArgumentNames(), std::vector<std::string>{"input"});
+
+  // the cached methods are dropped with the object and looked up again
+  model.unload();
+  ASSERT_TRUE(ref_output.equal(forward({input.alias()}).toTensor()));
+  torch::deploy::PythonMethodWrapper again(model, "forward");
+  ASSERT_EQ(again.getArgumentNames(), std::vector<std::string>{"input"});
 }
 
 TEST(TorchpyTest, ThreadedSimpleModel) {
@@ -198,6 +590,42 @@ TEST(TorchpyTest, ThreadedSimpleModel) {
   }
 }
 
+TEST(TorchpyTest, SubmitSimpleModel) {
+  size_t ninterp = 3;
+  torch::deploy::InterpreterManager manager(ninterp);
+
+  torch::deploy::Package p = manager.loadPackage(path("SIMPLE", simple));
+  auto model = p.loadPickle("model", "model.pkl");
+  auto ref_model = torch::jit::load(path("SIMPLE_JIT", simple_jit));
+
+  auto input = torch::ones({10, 20});
+
+  std::vector<c10::intrusive_ptr<c10::ivalue::Future>> futures;
+  for (const auto i : c10::irange(4 * ninterp)) {
+    (void)i;
+    futures.push_back(manager.submit(model, {input.alias()}));
+  }
+  std::unordered_map<std::string, c10::IValue> kwargs;
+  kwargs["input"] = input;
+  futures.push_back(manager.submit(model, {}, kwargs));
+
+  // Generate reference
+  auto ref_output = ref_model.forward({input.alias()}).toTensor();
+
+  // Compare all to reference
+  for (auto& future : futures) {
+    future->wait();
+    ASSERT_FALSE(future->hasError());
+    ASSERT_TRUE(ref_output.equal(future->value().toTensor()));
+  }
+
+  // errors raised by the call are reported through the future
+  auto failed = manager.submit(model, {at::IValue("not a tensor")});
+  failed->wait();
+  ASSERT_TRUE(failed->hasError());
+  EXPECT_THROW(failed->value(), std::runtime_error);
+}
+
 TEST(TorchpyTest, ErrorsReplicatingObj) {
   torch::deploy::InterpreterManager manager(4);
   torch::deploy::Package p = manager.loadPackage(path("SIMPLE", simple));
@@ -367,6 +795,237 @@ def get_tensor():
   ASSERT_TRUE(tensorOnI.storage().is_alias_of(tensorOnI2.storage()));
 }
 
+TEST(TorchpyTest, DeduplicatedMovables) {
+  torch::deploy::InterpreterManager manager(2);
+  torch::deploy::Package p = manager.loadPackage(path("SIMPLE", simple));
+  auto I = p.acquireSession();
+  auto model = I.self.attr("load_pickle")({"model", "model.pkl"});
+
+  auto first = manager.createMovable(model, &I, /*deduplicate*/ true);
+  auto second = p.createMovable(model, &I, /*deduplicate*/ true);
+  auto third = manager.createMovable(model, &I);
+
+  auto J = manager.allInstances()[1].acquireSession();
+  auto id = J.global("builtins", "id");
+  auto idOf = [&](const torch::deploy::ReplicatedObj& obj) {
+    return id({J.fromMovable(obj)}).toIValue().toInt();
+  };
+  ASSERT_EQ(idOf(first), idOf(second));
+  ASSERT_NE(idOf(first), idOf(third));
+}
+
+TEST(TorchpyTest, MoveObjBetweenSessions) {
+  torch::deploy::InterpreterManager manager(2);
+  manager.registerModuleSource("stages", R"PYTHON(
+import torch
+
+def produce():
+    return {"features": torch.ones(2, 2), "label": "a"}
+
+def consume(batch):
+    return batch["features"]
+)PYTHON");
+
+  auto I = manager.allInstances()[0].acquireSession();
+  auto I2 = manager.allInstances()[1].acquireSession();
+  auto produced = I.global("stages", "produce")(at::ArrayRef<at::IValue>{});
+  auto moved = I.moveTo(produced, I2);
+  ASSERT_TRUE(I2.isOwner(moved));
+
+  auto tensorOnI = I.global("stages", "consume")({produced}).toIValue();
+  auto tensorOnI2 = I2.global("stages", "consume")({moved}).toIValue();
+  ASSERT_TRUE(tensorOnI.toTensor().storage().is_alias_of(
+      tensorOnI2.toTensor().storage()));
+}
+
+TEST(TorchpyTest, TensorArgumentsAreNotCopied) {
+  torch::deploy::InterpreterManager manager(1);
+  auto I = manager.acquireOne();
+  auto identity = I.global("builtins", "eval")({at::IValue("lambda x: x")});
+
+  at::Tensor input = torch::ones({2, 2});
+  at::Tensor output = identity({input}).toIValue().toTensor();
+  ASSERT_TRUE(output.is_same(input));
+
+  // undefined tensors and scalars still go through the general conversion
+  ASSERT_TRUE(identity({at::Tensor()}).toIValue().isNone());
+  ASSERT_TRUE(identity({at::IValue(3)}).toIValue().isInt());
+}
+
+TEST(TorchpyTest, BatchedObjSplitsResults) {
+  size_t nthreads = 8;
+  torch::deploy::InterpreterManager manager(2);
+  manager.registerModuleSource("test_module", R"PYTHON(
+calls = 0
+
+def scale_and_add(x, y):
+    global calls
+    calls += 1
+    return x * 2, x + y
+)PYTHON");
+
+  torch::deploy::ReplicatedObj fn;
+  {
+    auto I = manager.acquireOne();
+    fn = manager.createMovable(I.global("test_module", "scale_and_add"), &I);
+  }
+  auto countCalls = [&manager]() {
+    int64_t calls = 0;
+    for (auto& interp : manager.allInstances()) {
+      auto I = interp.acquireSession();
+      calls += I.global("test_module", "calls").toIValue().toInt();
+    }
+    return calls;
+  };
+
+  // a leader waits for a full batch, so the calls are merged 4 by 4.
+  {
+    torch::deploy::BatchedObj batched(
+        fn, torch::deploy::BatchingOptions{4, std::chrono::seconds(10)});
+    std::vector<std::future<void>> futures;
+    for (const auto i : c10::irange(nthreads)) {
+      futures.push_back(std::async(std::launch::async, [&batched, i]() {
+        // callers use different batch sizes
+        auto x = torch::full({int64_t(i) + 1, 3}, double(i));
+        auto y = torch::ones({int64_t(i) + 1, 3});
+        auto result = batched({x, y}).toTupleRef().elements();
+        ASSERT_TRUE(result[0].toTensor().equal(x * 2));
+        ASSERT_TRUE(result[1].toTensor().equal(x + y));
+      }));
+    }
+    for (auto& future : futures) {
+      future.get();
+    }
+  }
+  ASSERT_EQ(countCalls(), int64_t(nthreads / 4));
+
+  torch::deploy::BatchedObj batched(
+      fn, torch::deploy::BatchingOptions{4, std::chrono::milliseconds(10)});
+  std::vector<std::future<void>> futures;
+
+  // calls whose inputs cannot be concatenated are run in separate batches
+  // instead of failing each other.
+  for (const auto i : c10::irange(nthreads)) {
+    futures.push_back(std::async(std::launch::async, [&batched, i]() {
+      auto x = torch::full({2, i % 2 ? 5 : 3}, double(i));
+      auto result = batched({x, x}).toTupleRef().elements();
+      ASSERT_TRUE(result[0].toTensor().equal(x * 2));
+      ASSERT_TRUE(result[1].toTensor().equal(x + x));
+    }));
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+
+  // calls with non-tensor arguments are not batched
+  auto result = batched({torch::ones({2, 3}), 1}).toTupleRef().elements();
+  ASSERT_TRUE(result[1].toTensor().equal(torch::full({2, 3}, 2.)));
+}
+
+TEST(EmbeddedFileTest, FileHasContents) {
+  std::string path = "/tmp/multipy_contentsXXXXXX";
+  int fd = mkstemp(&path[0]);
+  ASSERT_NE(fd, -1);
+  std::string payload = "payload";
+  ASSERT_EQ(write(fd, payload.data(), payload.size()), payload.size());
+  close(fd);
+  EXPECT_TRUE(torch::deploy::fileHasContents(
+      path, payload.data(), payload.size()));
+  // same size, different bytes, as with a colliding hash.
+  EXPECT_FALSE(torch::deploy::fileHasContents(path, "PAYLOAD", 7));
+  EXPECT_FALSE(torch::deploy::fileHasContents(path, payload.data(), 3));
+  unlink(path.c_str());
+  EXPECT_FALSE(torch::deploy::fileHasContents(
+      path, payload.data(), payload.size()));
+}
+
+torch::deploy::CustomLibraryPtr loadTestLibrary(
+    const torch::deploy::LoaderOptions& options) {
+  auto lib = torch::deploy::CustomLibrary::create(
+      path(
+          "LIBTEST_LOADER_LIB", "multipy/runtime/build/libtest_loader_lib.so"),
+      0,
+      nullptr,
+      options);
+  lib->add_search_library(torch::deploy::SystemLibrary::create());
+  lib->load();
+  return lib;
+}
+
+template <typename T>
+T testLibrarySym(const torch::deploy::CustomLibrary& lib, const char* name) {
+  auto addr = lib.sym(name);
+  EXPECT_TRUE(addr.has_value()) << name;
+  return reinterpret_cast<T>(addr.value_or(0));
+}
+
+// checks that both loads of the test library applied the same relocations.
+void expectSameRelocations(
+    const torch::deploy::CustomLibrary& a,
+    const torch::deploy::CustomLibrary& b) {
+  for (const auto* lib : {&a, &b}) {
+    EXPECT_TRUE(testLibrarySym<bool (*)()>(*lib, "loader_lib_check")());
+  }
+  size_t numLocal = testLibrarySym<size_t (*)()>(a, "loader_lib_num_local")();
+  auto localA = testLibrarySym<const int* const*>(a, "loader_lib_local_table");
+  auto localB = testLibrarySym<const int* const*>(b, "loader_lib_local_table");
+  auto itemsA = testLibrarySym<const int* (*)()>(a, "loader_lib_items")();
+  auto itemsB = testLibrarySym<const int* (*)()>(b, "loader_lib_items")();
+  for (size_t i = 0; i < numLocal; ++i) {
+    ASSERT_EQ(localA[i] - itemsA, localB[i] - itemsB) << i;
+  }
+  size_t numExternal =
+      testLibrarySym<size_t (*)()>(a, "loader_lib_num_external")();
+  auto externalA = testLibrarySym<void* const*>(a, "loader_lib_external_table");
+  auto externalB = testLibrarySym<void* const*>(b, "loader_lib_external_table");
+  ASSERT_EQ(memcmp(externalA, externalB, numExternal * sizeof(void*)), 0);
+}
+
+TEST(LoaderTest, LazyBinding) {
+  torch::deploy::LoaderOptions options;
+  options.lazy_binding = true;
+  auto lib = loadTestLibrary(options);
+  auto call = testLibrarySym<int (*)(const char*)>(*lib, "loader_lib_call");
+  // the first call binds strlen and loader_lib_add, the second one calls
+  // them through their bound entries.
+  ASSERT_EQ(call("abc"), 4);
+  ASSERT_EQ(call("abcdef"), 7);
+  expectSameRelocations(*lib, *loadTestLibrary(torch::deploy::LoaderOptions()));
+}
+
+TEST(LoaderTest, RelocationThreads) {
+  torch::deploy::LoaderOptions serial;
+  serial.relocation_threads = 1;
+  torch::deploy::LoaderOptions parallel;
+  parallel.relocation_threads = 4;
+  expectSameRelocations(*loadTestLibrary(serial), *loadTestLibrary(parallel));
+}
+
+TEST(LoaderTest, SharedPages) {
+  torch::deploy::LoaderOptions options;
+  options.share_pages = true;
+  auto first = loadTestLibrary(options);
+  size_t savedBefore = torch::deploy::CustomLibrary::shared_bytes_saved();
+  auto second = loadTestLibrary(options);
+  // at least the pages of loader_lib_external_table are the same in both.
+  ASSERT_GE(
+      torch::deploy::CustomLibrary::shared_bytes_saved() - savedBefore, 8192u);
+  expectSameRelocations(*first, *second);
+}
+
+TEST(LoaderTest, RelocationSnapshots) {
+  torch::deploy::LoaderOptions options;
+  options.relocation_snapshots = true;
+  auto fresh = loadTestLibrary(torch::deploy::LoaderOptions());
+  ASSERT_FALSE(fresh->relocations_replayed());
+  // the first load records a snapshot, unless an earlier one already did.
+  auto recorded = loadTestLibrary(options);
+  auto replayed = loadTestLibrary(options);
+  ASSERT_TRUE(replayed->relocations_replayed());
+  expectSameRelocations(*fresh, *replayed);
+  expectSameRelocations(*recorded, *replayed);
+}
+
 #ifdef TEST_CUSTOM_LIBRARY
 thread_local int in_another_module = 5;
 TEST(TorchpyTest, SharedLibraryLoad) {
@@ -0,0 +1,89 @@
+// Copyright (c) Meta Platforms, Inc. and affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+// A library without dependencies on python, loaded with CustomLibrary by the
+// LoaderTest tests of test_deploy.cpp.
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+// enough relocations pointing into the library for the loader to spread them
+// over several threads.
+constexpr size_t kNumLocal = 70000;
+// two pages of relocations pointing into libc, which are the same in every
+// load and so can be shared.
+constexpr size_t kNumExternal = 1024;
+
+int items[kNumLocal];
+
+constexpr std::array<const int*, kNumLocal> makeLocalTable() {
+  std::array<const int*, kNumLocal> table{};
+  for (size_t i = 0; i < kNumLocal; ++i) {
+    table[i] = &items[i];
+  }
+  return table;
+}
+
+using StrlenFn = size_t (*)(const char*);
+
+constexpr std::array<StrlenFn, kNumExternal> makeExternalTable() {
+  std::array<StrlenFn, kNumExternal> table{};
+  for (size_t i = 0; i < kNumExternal; ++i) {
+    table[i] = &strlen;
+  }
+  return table;
+}
+} // namespace
+
+extern "C" {
+
+extern const std::array<const int*, kNumLocal> loader_lib_local_table;
+const std::array<const int*, kNumLocal> loader_lib_local_table =
+    makeLocalTable();
+
+extern const std::array<StrlenFn, kNumExternal> loader_lib_external_table;
+alignas(4096) const std::array<StrlenFn, kNumExternal>
+    loader_lib_external_table = makeExternalTable();
+
+size_t loader_lib_num_local() {
+  return kNumLocal;
+}
+
+size_t loader_lib_num_external() {
+  return kNumExternal;
+}
+
+const int* loader_lib_items() {
+  return items;
+}
+
+// exported, so calls from inside the library go through the PLT.
+__attribute__((noinline)) int loader_lib_add(int a, int b) {
+  return a + b;
+}
+
+int loader_lib_call(const char* s) {
+  // strlen and loader_lib_add are both called through the PLT.
+  return loader_lib_add(static_cast<int>(strlen(s)), 1);
+}
+
+// true if every relocation of the tables points where it should.
+bool loader_lib_check() {
+  for (size_t i = 0; i < kNumLocal; ++i) {
+    if (loader_lib_local_table[i] != &items[i]) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < kNumExternal; ++i) {
+    if (loader_lib_external_table[i] != &strlen) {
+      return false;
+    }
+  }
+  return true;
+}
+}
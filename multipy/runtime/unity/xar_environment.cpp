@@ -9,8 +9,10 @@
 #include <fmt/format.h>
 #include <multipy/runtime/Exception.h>
 #include <multipy/runtime/elf_file.h>
+#include <multipy/runtime/embedded_file.h>
 #include <multipy/runtime/unity/xar_environment.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 namespace torch {
 namespace deploy {
@@ -120,22 +122,87 @@ void XarEnvironment::setupPythonApp() {
   auto r = mkdir(pythonAppDir_.c_str(), 0777);
   MULTIPY_CHECK(r == 0, "Failed to create directory: " + strerror(errno));
 
-  std::string pythonAppArchive = std::string(pythonAppDir_) + "/python_app.xar";
+  const std::string& cacheDir = payloadCacheDir();
+  if (cacheDir.empty()) {
+    extractPythonApp(
+        pythonAppPkgStart, pythonAppPkgSize, pythonAppDir_, pythonAppRoot_);
+  } else {
+    // the extracted application is kept in the payload cache, next to the
+    // archive it was extracted from, and pythonAppRoot_ links to it so that
+    // LD_LIBRARY_PATH stays unchanged.
+    std::string cachedDir = fmt::format(
+        "{}/python_app-{}-{}",
+        cacheDir,
+        payloadHash(pythonAppPkgStart, pythonAppPkgSize),
+        pythonAppPkgSize);
+    // the archive tells whether the entry holds this application, since the
+    // hash in its name can collide.
+    auto isCached = [&]() {
+      return _dirExists(cachedDir + "/python_app_root") &&
+          fileHasContents(
+                 cachedDir + "/python_app.xar",
+                 pythonAppPkgStart,
+                 pythonAppPkgSize);
+    };
+    bool cached = isCached();
+    if (!cached && !_dirExists(cachedDir)) {
+      std::string tmpDir = cacheDir + "/.python_app.XXXXXX";
+      MULTIPY_CHECK(
+          mkdtemp(&tmpDir[0]) != nullptr,
+          "Failed to create directory: " + strerror(errno));
+      extractPythonApp(
+          pythonAppPkgStart,
+          pythonAppPkgSize,
+          tmpDir,
+          tmpDir + "/python_app_root");
+      // publish the entry atomically. If another process got there first the
+      // rename fails and its copy is used instead, provided it is complete.
+      if (rename(tmpDir.c_str(), cachedDir.c_str()) == 0) {
+        cached = true;
+      } else {
+        int error = errno;
+        cached = (error == EEXIST || error == ENOTEMPTY) && isCached();
+        LOG_IF(WARNING, !cached)
+            << "Failed to publish " << cachedDir << ": " << strerror(error);
+        std::string rmTmpCmd = fmt::format("rm -rf {}", tmpDir);
+        (void)system(rmTmpCmd.c_str());
+      }
+    }
+    if (cached) {
+      MULTIPY_CHECK(
+          symlink(
+              (cachedDir + "/python_app_root").c_str(),
+              pythonAppRoot_.c_str()) == 0,
+          "Failed to link the python app root: " + strerror(errno));
+    } else {
+      // the entry is taken by another application or could not be written.
+      extractPythonApp(
+          pythonAppPkgStart, pythonAppPkgSize, pythonAppDir_, pythonAppRoot_);
+    }
+  }
+
+  alreadySetupPythonApp_ = true;
+}
+
+void XarEnvironment::extractPythonApp(
+    const char* pkgStart,
+    size_t pkgSize,
+    const std::string& archiveDir,
+    const std::string& appRoot) {
+  std::string pythonAppArchive = archiveDir + "/python_app.xar";
   auto fp = fopen(pythonAppArchive.c_str(), "wb");
   MULTIPY_CHECK(fp != nullptr, "Fail to create file: " + strerror(errno));
-  auto written = fwrite(pythonAppPkgStart, 1, pythonAppPkgSize, fp);
-  MULTIPY_CHECK(written == pythonAppPkgSize, "Expected written == size");
+  auto written = fwrite(pkgStart, 1, pkgSize, fp);
+  MULTIPY_CHECK(written == pkgSize, "Expected written == size");
   fclose(fp);
 
   std::string extractCommand = fmt::format(
-      "unsquashfs -o 4096 -d {} {}", pythonAppRoot_, pythonAppArchive);
-  r = system(extractCommand.c_str());
+      "unsquashfs -o 4096 -d {} {}", appRoot, pythonAppArchive);
+  auto r = system(extractCommand.c_str());
   MULTIPY_CHECK(
       r == 0,
       "Fail to extract the python package" + std::to_string(r) +
           extractCommand.c_str());
-
-  alreadySetupPythonApp_ = true;
 }
 
 void XarEnvironment::preloadSharedLibraries() {
@@ -27,6 +27,13 @@ class XarEnvironment : public Environment {
 
  private:
   void setupPythonApp();
+  /// Writes the python app archive to `archiveDir` and unpacks it to
+  /// `appRoot`.
+  void extractPythonApp(
+      const char* pkgStart,
+      size_t pkgSize,
+      const std::string& archiveDir,
+      const std::string& appRoot);
   void preloadSharedLibraries();
 
   std::string exePath_;
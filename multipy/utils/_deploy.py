@@ -72,6 +72,39 @@ def _save_storages(importer, obj):
     )
 
 
+class _BufferReader:
+    """Read-only file over a buffer, which unlike io.BytesIO does not copy it
+    up front. The unpickler needs the results of read() as bytes, so each byte
+    it reads that way is still copied once; readinto() copies straight into the
+    caller's buffer, e.g. for the bytearrays of pickle protocol 5."""
+
+    def __init__(self, buffer):
+        self._view = memoryview(buffer).cast("B")
+        self._pos = 0
+
+    def read(self, size=-1):
+        end = len(self._view) if size < 0 else min(self._pos + size, len(self._view))
+        data = self._view[self._pos : end].tobytes()
+        self._pos = end
+        return data
+
+    def readinto(self, b):
+        n = min(len(b), len(self._view) - self._pos)
+        b[:n] = self._view[self._pos : self._pos + n]
+        self._pos += n
+        return n
+
+    def readline(self):
+        end = self._pos
+        while end < len(self._view):
+            newline = self._view[end : end + 256].tobytes().find(b"\n")
+            if newline >= 0:
+                end += newline + 1
+                break
+            end += 256
+        return self.read(end - self._pos)
+
+
 def _load_storages(id, zip_reader, obj_bytes, serialized_storages, serialized_dtypes):
     def persistent_load(saved_id):
         assert isinstance(saved_id, tuple)
@@ -106,9 +139,12 @@ def _load_storages(id, zip_reader, obj_bytes, serialized_storages, serialized_dt
     else:
         importer = sys_importer
 
-    unpickler = PackageUnpickler(importer, io.BytesIO(obj_bytes))
+    unpickler = PackageUnpickler(importer, _BufferReader(obj_bytes))
     unpickler.persistent_load = persistent_load  # type: ignore[assignment]
-    result = _deploy_objects[id] = unpickler.load()
+    result = unpickler.load()
+    # objects moved between sessions have no id and are not kept alive here
+    if id is not None:
+        _deploy_objects[id] = result
     return result
 
 